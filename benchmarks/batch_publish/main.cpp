@@ -0,0 +1,58 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "../common/bench.h"
+
+// bulk publishing, publishBytes per message versus publishBatch with one buffer and one write per batch
+static qint64 run(Nats::Client &client, int count, int batch_size, const QList<QByteArray> &payloads, bool batched)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int sent = 0; sent < count; sent += batch_size)
+    {
+        if(batched)
+        {
+            client.publishBatch("bench.batch", payloads);
+        }
+        else
+        {
+            for(const QByteArray &payload : payloads)
+                client.publishBytes("bench.batch", payload);
+        }
+
+        QCoreApplication::processEvents();
+    }
+
+    if(!client.flushSync(60000))
+        qWarning() << "flush failed";
+
+    return timer.nsecsElapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "2000000").toInt();
+    const int payload_size = a.arguments().value(2, "64").toInt();
+    const int batch_size = a.arguments().value(3, "1000").toInt();
+
+    MockServer server;
+
+    Nats::Client client;
+    connect_client(client, server);
+
+    const QList<QByteArray> payloads(batch_size, QByteArray(payload_size, 'x'));
+    const qint64 messages = (count + batch_size - 1) / batch_size * qint64(batch_size);
+
+    const qint64 single = run(client, count, batch_size, payloads, false);
+    const qint64 batched = run(client, count, batch_size, payloads, true);
+
+    report("publishBytes", messages, payload_size, single);
+    report("publishBatch", messages, payload_size, batched);
+
+    qDebug().noquote() << QString("speedup: %1x").arg(double(single) / batched, 0, 'f', 1);
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+TEMPLATE = subdirs
+
+# pub, batch_publish, sub, fanout, request, parser and dispatch run against in-process mock server
+# nuid needs no server, threaded_publish needs nats server on 127.0.0.1:4222
+SUBDIRS += \
+    pub \
+    batch_publish \
+    sub \
+    fanout \
+    request \
+    parser \
+    dispatch \
+    nuid \
+    threaded_publish
@@ -0,0 +1,295 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QEventLoop>
+#include <QSemaphore>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QVarLengthArray>
+
+#include "../../natsclient.h"
+
+//!
+//! \brief The MockServer class
+//! minimal in-process stand-in for nats-server running on its own thread, so benchmarks need no external server
+//! speaks INFO, CONNECT, PUB, HPUB, SUB, UNSUB, PING and PONG, routes with wildcards and queue groups
+//! no verbose mode, authentication, clustering or JetStream
+class MockServer
+{
+public:
+    MockServer()
+    {
+        QSemaphore ready;
+
+        m_thread = QThread::create([this, &ready]
+        {
+            run(ready);
+        });
+
+        m_thread->start();
+        ready.acquire();
+    }
+
+    ~MockServer()
+    {
+        m_thread->quit();
+        m_thread->wait();
+        delete m_thread;
+    }
+
+    MockServer(const MockServer &) = delete;
+    MockServer &operator=(const MockServer &) = delete;
+
+    quint16 port() const
+    {
+        return m_port;
+    }
+
+private:
+
+    struct Subscription
+    {
+        QByteArray sid;
+        QByteArray subject;
+        QByteArray queue;
+        bool wildcard;
+    };
+
+    struct Connection
+    {
+        QTcpSocket *socket;
+        QByteArray input;
+        QByteArray output;
+        QList<Subscription> subscriptions;
+    };
+
+    void run(QSemaphore &ready)
+    {
+        QTcpServer server;
+        server.listen(QHostAddress::LocalHost);
+        m_port = server.serverPort();
+
+        QObject::connect(&server, &QTcpServer::newConnection, [this, &server]
+        {
+            while(QTcpSocket *socket = server.nextPendingConnection())
+            {
+                auto connection = new Connection{socket, {}, {}, {}};
+                m_connections.append(connection);
+
+                socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                socket->write("INFO {\"server_id\":\"mock\",\"version\":\"2.10.0\",\"proto\":1,\"headers\":true,\"max_payload\":1048576}\r\n");
+
+                QObject::connect(socket, &QTcpSocket::readyRead, [this, connection]
+                {
+                    process(*connection);
+                });
+
+                // removal is deferred, socket can disconnect while routing is in progress
+                QObject::connect(socket, &QTcpSocket::disconnected, [this, connection]
+                {
+                    QMetaObject::invokeMethod(connection->socket, [this, connection]
+                    {
+                        m_connections.removeOne(connection);
+                        connection->socket->deleteLater();
+                        delete connection;
+                    }, Qt::QueuedConnection);
+                });
+            }
+        });
+
+        ready.release();
+
+        QEventLoop loop;
+        loop.exec();
+
+        qDeleteAll(m_connections);
+        m_connections.clear();
+    }
+
+    static QVarLengthArray<QByteArrayView, 6> split(QByteArrayView line)
+    {
+        QVarLengthArray<QByteArrayView, 6> args;
+        qsizetype start = -1;
+
+        for(qsizetype i = 0; i <= line.size(); ++i)
+        {
+            const bool separator = (i == line.size() || line[i] == ' ' || line[i] == '\t');
+
+            if(!separator && start < 0)
+                start = i;
+            else if(separator && start >= 0)
+            {
+                args.append(line.sliced(start, i - start));
+                start = -1;
+            }
+        }
+
+        return args;
+    }
+
+    void process(Connection &connection)
+    {
+        connection.input.append(connection.socket->readAll());
+
+        const char *data = connection.input.constData();
+        qsizetype position = 0;
+
+        forever
+        {
+            const qsizetype end = connection.input.indexOf("\r\n", position);
+            if(end < 0)
+                break;
+
+            const auto args = split(QByteArrayView(data + position, end - position));
+            const QByteArrayView op = args.isEmpty() ? QByteArrayView() : args[0];
+
+            const bool hpub = (op.compare("HPUB", Qt::CaseInsensitive) == 0);
+
+            if(hpub || op.compare("PUB", Qt::CaseInsensitive) == 0)
+            {
+                // PUB <subject> [reply] <size>, HPUB <subject> [reply] <header size> <size>
+                const qsizetype required = hpub ? 4 : 3;
+                const qsizetype size = (args.size() >= required) ? Nats::Parser::parse_uint(args[args.size() - 1]) : -1;
+                const qsizetype header_size = (hpub && size >= 0) ? Nats::Parser::parse_uint(args[args.size() - 2]) : 0;
+
+                // malformed line is skipped
+                if(size < 0 || header_size < 0)
+                {
+                    position = end + 2;
+                    continue;
+                }
+
+                const QByteArrayView reply = (args.size() > required) ? args[2] : QByteArrayView();
+
+                // wait for rest of payload
+                if(end + 2 + size + 2 > connection.input.size())
+                    break;
+
+                route(args[1], reply, header_size, QByteArrayView(data + end + 2, size), hpub);
+
+                position = end + 2 + size + 2;
+                continue;
+            }
+
+            if(op.compare("SUB", Qt::CaseInsensitive) == 0 && args.size() >= 3)
+            {
+                const QByteArray subject = args[1].toByteArray();
+                const QByteArray queue = (args.size() > 3) ? args[2].toByteArray() : QByteArray();
+
+                connection.subscriptions.append(Subscription{args[args.size() - 1].toByteArray(), subject, queue,
+                                                             subject.contains('*') || subject.contains('>')});
+            }
+            else if(op.compare("UNSUB", Qt::CaseInsensitive) == 0 && args.size() >= 2)
+            {
+                const QByteArrayView sid = args[1];
+                connection.subscriptions.removeIf([sid](const Subscription &subscription)
+                {
+                    return subscription.sid == sid;
+                });
+            }
+            else if(op.compare("PING", Qt::CaseInsensitive) == 0)
+            {
+                connection.output.append("PONG\r\n");
+            }
+
+            position = end + 2;
+        }
+
+        connection.input.remove(0, position);
+
+        // everything routed in this pass goes out with one write per connection
+        for(Connection *target : std::as_const(m_connections))
+        {
+            if(target->output.isEmpty())
+                continue;
+
+            target->socket->write(target->output);
+            target->output.resize(0);
+        }
+    }
+
+    void route(QByteArrayView subject, QByteArrayView reply, qsizetype header_size, QByteArrayView data, bool headers)
+    {
+        QVarLengthArray<QByteArrayView, 4> queues;
+
+        for(Connection *target : std::as_const(m_connections))
+        {
+            for(const Subscription &subscription : std::as_const(target->subscriptions))
+            {
+                const bool match = subscription.wildcard ? Nats::Sublist::matches(subscription.subject, subject)
+                                                         : subscription.subject == subject;
+                if(!match)
+                    continue;
+
+                // one member per queue group
+                if(!subscription.queue.isEmpty())
+                {
+                    if(queues.contains(subscription.queue))
+                        continue;
+
+                    queues.append(subscription.queue);
+                }
+
+                QByteArray &output = target->output;
+                output.append(headers ? "HMSG " : "MSG ");
+                output.append(subject);
+                output.append(' ');
+                output.append(subscription.sid);
+                output.append(' ');
+
+                if(!reply.isEmpty())
+                {
+                    output.append(reply);
+                    output.append(' ');
+                }
+
+                if(headers)
+                {
+                    Nats::append_number(output, uint64_t(header_size));
+                    output.append(' ');
+                }
+
+                Nats::append_number(output, uint64_t(data.size()));
+                output.append("\r\n", 2);
+                output.append(data);
+                output.append("\r\n", 2);
+            }
+        }
+    }
+
+    QThread *m_thread = nullptr;
+    quint16 m_port = 0;
+
+    //! used only from server thread
+    QList<Connection *> m_connections;
+};
+
+//!
+//! \brief report
+//! print rate in 'nats bench' style
+inline void report(const char *name, qint64 count, qint64 payload_size, qint64 nsecs)
+{
+    const double seconds = double(nsecs) / 1e9;
+
+    qDebug().noquote() << QString("%1 stats: %2 msgs/sec ~ %3 MB/sec (%4 msgs in %5 s)")
+                          .arg(QString::fromLatin1(name))
+                          .arg(count / seconds, 0, 'f', 0)
+                          .arg(double(count) * payload_size / seconds / (1024 * 1024), 0, 'f', 2)
+                          .arg(count)
+                          .arg(seconds, 0, 'f', 3);
+}
+
+//!
+//! \brief connect_client
+//! connect client to mock server, exits on failure
+inline void connect_client(Nats::Client &client, const MockServer &server)
+{
+    if(!client.connectSync("127.0.0.1", server.port()))
+    {
+        qCritical() << "can't connect to mock server";
+        ::exit(1);
+    }
+}
+
+#endif // BENCH_H
@@ -0,0 +1,171 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSemaphore>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+
+#include <atomic>
+
+#include "../../natsclient.h"
+
+// allocations per delivered message, glibc malloc is wrapped and counted on client thread only
+// server runs on its own thread and feeds canned MSG frames, no nats server needed
+static std::atomic<quint64> allocations{0};
+static thread_local bool counting = false;
+
+#ifdef __GLIBC__
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+
+    void *malloc(size_t size)
+    {
+        if(counting)
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        if(counting)
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size)
+    {
+        if(counting)
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(pointer, size);
+    }
+}
+#endif
+
+static void serve(quint16 *port, QSemaphore *ready, int count, int payload_size)
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    *port = server.serverPort();
+    ready->release();
+
+    if(!server.waitForNewConnection(10000))
+        return;
+
+    QTcpSocket *socket = server.nextPendingConnection();
+    socket->write("INFO {\"server_id\":\"bench\",\"version\":\"2.10.0\",\"headers\":true}\r\n");
+
+    // wait for subscription before sending anything
+    QByteArray input;
+    while(!input.contains("SUB "))
+    {
+        if(!socket->waitForReadyRead(10000))
+            return;
+
+        input += socket->readAll();
+    }
+
+    const QByteArray payload(payload_size, 'x');
+    const QByteArray frame = "MSG bench.subject 1 " + QByteArray::number(payload_size) + "\r\n" + payload + "\r\n";
+
+    QByteArray chunk;
+    for(int i = 0; i < 1000; ++i)
+        chunk += frame;
+
+    for(int sent = 0; sent < count; sent += 1000)
+    {
+        socket->write(sent + 1000 <= count ? chunk : chunk.left(frame.size() * (count - sent)));
+
+        while(socket->bytesToWrite() > 4 * 1024 * 1024)
+            socket->waitForBytesWritten(10000);
+    }
+
+    // answer flush and keepalive until client goes away
+    while(socket->state() == QAbstractSocket::ConnectedState)
+    {
+        socket->waitForBytesWritten(100);
+
+        if(!socket->waitForReadyRead(100))
+            continue;
+
+        const int pings = socket->readAll().count("PING\r\n");
+        for(int i = 0; i < pings; ++i)
+            socket->write("PONG\r\n");
+    }
+}
+
+static void run(const char *name, bool legacy, int count, int payload_size)
+{
+    quint16 port = 0;
+    QSemaphore ready;
+
+    QThread *server = QThread::create(serve, &port, &ready, count, payload_size);
+    server->start();
+    ready.acquire();
+
+    Nats::Client client;
+    QEventLoop loop;
+    QElapsedTimer timer;
+
+    // first messages warm up buffers and queues
+    const int warmup = count / 10;
+    int received = 0;
+    quint64 start = 0;
+
+    auto on_message = [&]
+    {
+        if(++received == warmup)
+        {
+            start = allocations.load();
+            timer.start();
+        }
+
+        if(received == count)
+            loop.quit();
+    };
+
+    client.connect("127.0.0.1", port, [&]
+    {
+        if(legacy)
+            client.subscribe("bench.subject", [&](QString &&, QString &&, QString &&) { on_message(); });
+        else
+            client.subscribe("bench.subject", [&](const Nats::Message &) { on_message(); });
+    });
+
+    counting = true;
+    loop.exec();
+    counting = false;
+
+    const qint64 elapsed = timer.nsecsElapsed();
+    const quint64 total = allocations.load() - start;
+    const int measured = count - warmup;
+
+    qDebug().noquote() << QString("%1: %2 msgs/s, %3 allocations/msg")
+                          .arg(name)
+                          .arg(measured / (double(elapsed) / 1e9), 0, 'f', 0)
+                          .arg(double(total) / measured, 0, 'f', 4);
+
+    client.disconnect();
+    server->wait();
+    delete server;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "1000000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+
+#ifndef __GLIBC__
+    qWarning() << "allocation counting needs glibc, only throughput is measured";
+#endif
+
+    run("Message handler ", false, count, payload_size);
+    run("legacy callback ", true, count, payload_size);
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "../common/bench.h"
+
+// one publisher, many subscribers, like 'nats bench foo --pub 1 --sub 4', aggregate delivery rate is reported
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "250000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+    const int subscribers = a.arguments().value(3, "4").toInt();
+
+    MockServer server;
+
+    Nats::Client publisher;
+    connect_client(publisher, server);
+
+    QEventLoop loop;
+    QElapsedTimer timer;
+    qint64 received = 0;
+    const qint64 expected = qint64(count) * subscribers;
+
+    QList<Nats::Client *> clients;
+    for(int s = 0; s < subscribers; ++s)
+    {
+        auto client = new Nats::Client;
+        connect_client(*client, server);
+
+        const uint64_t ssid = client->subscribe("bench.fanout", [&](const Nats::Message &)
+        {
+            if(++received == 1)
+                timer.start();
+
+            if(received == expected)
+                loop.quit();
+        });
+
+        client->setPendingLimits(ssid, -1, -1);
+        client->flushSync();
+        clients.append(client);
+    }
+
+    const QByteArray payload(payload_size, 'x');
+    int sent = 0;
+
+    QTimer pump;
+    QObject::connect(&pump, &QTimer::timeout, [&]
+    {
+        for(int i = 0; i < 1000 && sent < count; ++i, ++sent)
+            publisher.publishBytes("bench.fanout", payload);
+
+        if(sent == count)
+            pump.stop();
+    });
+
+    pump.start(0);
+    QTimer::singleShot(120000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    if(received != expected)
+        qWarning() << "received" << received << "of" << expected;
+
+    report("Fan-out", received, payload_size, timer.nsecsElapsed());
+
+    qDeleteAll(clients);
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QUuid>
+
+#include "../../natsclient.h"
+
+// compare inbox id generation with NUID against QUuid::createUuid
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "1000000").toInt();
+
+    Nats::Nuid nuid;
+    QElapsedTimer timer;
+    qsizetype total = 0;
+
+    timer.start();
+    for(int i = 0; i < count; ++i)
+        total += nuid.next().size();
+    const qint64 nuid_ns = timer.nsecsElapsed();
+
+    timer.restart();
+    for(int i = 0; i < count; ++i)
+        total += QUuid::createUuid().toString().size();
+    const qint64 uuid_ns = timer.nsecsElapsed();
+
+    qDebug().noquote() << QString("NUID:  %1 ns/op").arg(double(nuid_ns) / count, 0, 'f', 1);
+    qDebug().noquote() << QString("QUuid: %1 ns/op").arg(double(uuid_ns) / count, 0, 'f', 1);
+    qDebug().noquote() << QString("speedup: %1x").arg(double(uuid_ns) / nuid_ns, 0, 'f', 1) << "(" << total << ")";
+
+    return 0;
+}
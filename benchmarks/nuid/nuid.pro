@@ -0,0 +1,16 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17
+
+TARGET = nuid
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+HEADERS += ../../natsclient.h
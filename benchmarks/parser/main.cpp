@@ -0,0 +1,78 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "../common/bench.h"
+
+// protocol parser alone on canned byte streams, no sockets involved
+class Counter : public Nats::Parser::Handler
+{
+public:
+    qint64 messages = 0;
+    qint64 bytes = 0;
+
+    void process_msg(const Nats::MsgArg &, const QByteArray &headers, const QByteArray &payload) override
+    {
+        messages++;
+        bytes += headers.size() + payload.size();
+    }
+
+    void process_ping() override {}
+    void process_pong() override {}
+    void process_ok() override {}
+    void process_err(QByteArrayView) override {}
+    void process_info(QByteArrayView) override {}
+};
+
+static void run(const char *name, const QByteArray &frame, int count, int chunk_size, int payload_size)
+{
+    // stream of frames cut into reads of chunk_size, frames split across reads like on a real socket
+    QByteArray stream;
+    for(int i = 0; i < 1000; ++i)
+        stream += frame;
+
+    QList<QByteArray> chunks;
+    for(qsizetype offset = 0; offset < stream.size(); offset += chunk_size)
+        chunks.append(stream.mid(offset, chunk_size));
+
+    Nats::Parser parser;
+    Counter counter;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i = 0; i < count; i += 1000)
+    {
+        for(const QByteArray &chunk : std::as_const(chunks))
+        {
+            if(!parser.parse(chunk, counter))
+            {
+                qCritical() << parser.error();
+                return;
+            }
+        }
+    }
+
+    report(name, counter.messages, payload_size, timer.nsecsElapsed());
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "5000000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+    const int chunk_size = a.arguments().value(3, "65536").toInt();
+
+    const QByteArray payload(payload_size, 'x');
+    const QByteArray size = QByteArray::number(payload_size);
+
+    const QByteArray headers = "NATS/1.0\r\nNats-Msg-Id: 1234567890\r\n\r\n";
+    const QByteArray total = QByteArray::number(headers.size() + payload_size);
+
+    run("MSG", "MSG bench.parser 1 " + size + "\r\n" + payload + "\r\n", count, chunk_size, payload_size);
+    run("MSG with reply", "MSG bench.parser 1 _INBOX.abcdefghijklmnopqrstuv.1 " + size + "\r\n" + payload + "\r\n", count, chunk_size, payload_size);
+    run("HMSG", "HMSG bench.parser 1 " + QByteArray::number(headers.size()) + " " + total + "\r\n" + headers + payload + "\r\n",
+        count, chunk_size, payload_size);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "../common/bench.h"
+
+// publish throughput, like 'nats bench foo --pub 1'
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "1000000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+
+    MockServer server;
+
+    Nats::Client client;
+    connect_client(client, server);
+
+    const QByteArray payload(payload_size, 'x');
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i = 0; i < count; ++i)
+    {
+        client.publishBytes("bench.pub", payload);
+
+        // let socket write, like an application returning to event loop
+        if(i % 1000 == 999)
+            QCoreApplication::processEvents();
+    }
+
+    if(!client.flushSync(60000))
+        qWarning() << "flush failed";
+
+    report("Pub", count, payload_size, timer.nsecsElapsed());
+
+    return 0;
+}
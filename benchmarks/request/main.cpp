@@ -0,0 +1,73 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "../common/bench.h"
+
+// sequential request/reply latency, like 'nats bench foo --pub 1 --sub 1 --request'
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "20000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+
+    MockServer server;
+
+    Nats::Client responder;
+    Nats::Client requester;
+    connect_client(responder, server);
+    connect_client(requester, server);
+
+    responder.subscribe("bench.request", [&responder](const Nats::Message &message)
+    {
+        responder.publishBytes(message.reply, message.payload);
+    });
+
+    responder.flushSync();
+
+    const QByteArray payload(payload_size, 'x');
+
+    QEventLoop loop;
+    QElapsedTimer total;
+    QElapsedTimer clock;
+    Nats::Histogram latency;
+    int completed = 0;
+
+    std::function<void()> next = [&]
+    {
+        const qint64 sent = clock.nsecsElapsed();
+
+        requester.request("bench.request", payload, [&, sent](const Nats::Message &)
+        {
+            latency.record((clock.nsecsElapsed() - sent) / 1000);
+
+            if(++completed == count)
+                loop.quit();
+            else
+                next();
+        }, 5000, [&](const QString &error)
+        {
+            qWarning() << "request failed:" << error;
+            loop.quit();
+        });
+    };
+
+    clock.start();
+    total.start();
+    next();
+
+    loop.exec();
+
+    report("Request", completed, payload_size, total.nsecsElapsed());
+
+    qDebug().noquote() << QString("Latency (us): p50 %1, p90 %2, p99 %3, p99.9 %4, max %5, mean %6")
+                          .arg(latency.percentile(50))
+                          .arg(latency.percentile(90))
+                          .arg(latency.percentile(99))
+                          .arg(latency.percentile(99.9))
+                          .arg(latency.max())
+                          .arg(latency.mean(), 0, 'f', 1);
+
+    return 0;
+}
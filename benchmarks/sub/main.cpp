@@ -0,0 +1,62 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "../common/bench.h"
+
+// subscribe throughput, like 'nats bench foo --pub 1 --sub 1', subscriber rate is reported
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int count = a.arguments().value(1, "1000000").toInt();
+    const int payload_size = a.arguments().value(2, "128").toInt();
+
+    MockServer server;
+
+    Nats::Client publisher;
+    Nats::Client subscriber;
+    connect_client(publisher, server);
+    connect_client(subscriber, server);
+
+    QEventLoop loop;
+    QElapsedTimer timer;
+    int received = 0;
+
+    const uint64_t ssid = subscriber.subscribe("bench.sub", [&](const Nats::Message &)
+    {
+        if(++received == 1)
+            timer.start();
+
+        if(received == count)
+            loop.quit();
+    });
+
+    // every message has to arrive
+    subscriber.setPendingLimits(ssid, -1, -1);
+    subscriber.flushSync();
+
+    const QByteArray payload(payload_size, 'x');
+    int sent = 0;
+
+    QTimer pump;
+    QObject::connect(&pump, &QTimer::timeout, [&]
+    {
+        for(int i = 0; i < 1000 && sent < count; ++i, ++sent)
+            publisher.publishBytes("bench.sub", payload);
+
+        if(sent == count)
+            pump.stop();
+    });
+
+    pump.start(0);
+    QTimer::singleShot(120000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    if(received != count)
+        qWarning() << "received" << received << "of" << count;
+
+    report("Sub", received, payload_size, timer.nsecsElapsed());
+
+    return 0;
+}
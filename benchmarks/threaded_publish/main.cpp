@@ -0,0 +1,80 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include "../../natsclient.h"
+
+// publish from worker threads, thread-safe publishBytes versus queued invokeMethod per message
+// requires nats server on 127.0.0.1:4222
+static double run(Nats::Client &client, int threads, int count, const QByteArray &payload, bool queued)
+{
+    QList<QThread *> producers;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int t = 0; t < threads; ++t)
+    {
+        producers.append(QThread::create([&client, count, payload, queued]
+        {
+            for(int i = 0; i < count; ++i)
+            {
+                if(queued)
+                {
+                    QMetaObject::invokeMethod(&client, [&client, payload]
+                    {
+                        client.publishBytes("bench.threaded", payload);
+                    }, Qt::QueuedConnection);
+                }
+                else
+                {
+                    client.publishBytes("bench.threaded", payload);
+                }
+            }
+        }));
+
+        producers.last()->start();
+    }
+
+    // client thread keeps draining while producers run
+    for(QThread *producer : std::as_const(producers))
+    {
+        while(!producer->wait(1))
+            QCoreApplication::processEvents();
+    }
+
+    QCoreApplication::processEvents();
+
+    if(!client.flushSync(60000))
+        qWarning() << "flush failed";
+
+    const qint64 elapsed = timer.nsecsElapsed();
+    qDeleteAll(producers);
+
+    return double(threads) * count / (double(elapsed) / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const int threads = a.arguments().value(1, "4").toInt();
+    const int count = a.arguments().value(2, "250000").toInt();
+    const QByteArray payload(a.arguments().value(3, "128").toInt(), 'x');
+
+    Nats::Client client;
+    if(!client.connectSync("127.0.0.1", 4222))
+    {
+        qCritical() << "can't connect to nats server on 127.0.0.1:4222";
+        return 1;
+    }
+
+    const double lock_free = run(client, threads, count, payload, false);
+    const double queued = run(client, threads, count, payload, true);
+
+    qDebug().noquote() << QString("lock-free queue: %1 msgs/s").arg(lock_free, 0, 'f', 0);
+    qDebug().noquote() << QString("queued signals:  %1 msgs/s").arg(queued, 0, 'f', 0);
+    qDebug().noquote() << QString("speedup: %1x").arg(lock_free / queued, 0, 'f', 1);
+
+    return 0;
+}
@@ -1,641 +1,6175 @@
 #ifndef NATSCLIENT_H
 #define NATSCLIENT_H
 
+#include <QElapsedTimer>
 #include <QHash>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLoggingCategory>
+#include <QMutex>
 #include <QObject>
+#include <QPointer>
 #include <QProcessEnvironment>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QRegularExpression>
 #include <QSslConfiguration>
 #include <QSslSocket>
 #include <QStringBuilder>
-#include <QUuid>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUrl>
+#include <QVarLengthArray>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+
+// awaitable API needs C++20 coroutines
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <optional>
+#define QT_NATS_COROUTINES
+#endif
 
 namespace Nats
 {
-    #define DEBUG(x) do { if (_debug_mode) { qDebug() << x; } } while (0)
+    //!
+    //! logging categories qt-nats.protocol, qt-nats.connection and qt-nats.dispatch, debug output is off by default
+    //! and can be enabled with QT_LOGGING_RULES or env variable DEBUG=qt-nats, define QT_NATS_NO_DEBUG
+    //! to compile tracing out completely
+    inline const QLoggingCategory &protocol_log()
+    {
+        static const QLoggingCategory category("qt-nats.protocol", QtWarningMsg);
+        return category;
+    }
+
+    inline const QLoggingCategory &connection_log()
+    {
+        static const QLoggingCategory category("qt-nats.connection", QtWarningMsg);
+        return category;
+    }
+
+    inline const QLoggingCategory &dispatch_log()
+    {
+        static const QLoggingCategory category("qt-nats.dispatch", QtWarningMsg);
+        return category;
+    }
+
+#ifdef QT_NATS_NO_DEBUG
+    #define DEBUG_PROTOCOL(x) do { } while (0)
+    #define DEBUG_CONNECTION(x) do { } while (0)
+    #define DEBUG_DISPATCH(x) do { } while (0)
+#else
+    #define DEBUG_PROTOCOL(x) qCDebug(Nats::protocol_log) << x
+    #define DEBUG_CONNECTION(x) qCDebug(Nats::connection_log) << x
+    #define DEBUG_DISPATCH(x) qCDebug(Nats::dispatch_log) << x
+#endif
+
+    //!
+    //! \brief enable_debug_from_environment
+    //! map DEBUG=qt-nats[.category] env variable to logging filter rules, done once per process
+    inline void enable_debug_from_environment()
+    {
+#ifndef QT_NATS_NO_DEBUG
+        static const bool applied = []
+        {
+            const QString debug = QProcessEnvironment::systemEnvironment().value(QStringLiteral("DEBUG"));
+
+            QStringList rules;
+            for(const QString &entry : debug.split(QRegularExpression(QStringLiteral("[,\\s]+")), Qt::SkipEmptyParts))
+            {
+                if(entry == QLatin1String("qt-nats"))
+                    rules.append(QStringLiteral("qt-nats.*.debug=true"));
+                else if(entry.startsWith(QLatin1String("qt-nats.")))
+                    rules.append(entry + QStringLiteral(".debug=true"));
+            }
+
+            if(!rules.isEmpty())
+                QLoggingCategory::setFilterRules(rules.join(QLatin1Char('\n')));
+
+            return true;
+        }();
+
+        Q_UNUSED(applied);
+#endif
+    }
+
+    //!
+    //! \brief The Headers class
+    //! NATS message headers, 'NATS/1.0[ <status>[ <description>]]\r\n<key>: <value>\r\n...\r\n'
+    //! received headers are kept as raw block and only parsed on first access
+    //! lazy parsing makes const access not thread-safe, use from one thread at a time
+    class Headers
+    {
+    public:
+        Headers() = default;
+        explicit Headers(const QByteArray &raw) : m_raw(raw)
+        {
+        }
+
+        //!
+        //! \brief isEmpty
+        //! \return true if there are no headers and no status
+        bool isEmpty() const;
+
+        //!
+        //! \brief status
+        //! \return inline status code, like 503 for no responders, 0 if there is none
+        int status() const;
+
+        //!
+        //! \brief description
+        //! \return description following status code
+        QByteArray description() const;
+
+        //!
+        //! \brief value
+        //! \return first value of header with given key, keys are compared case-insensitive
+        QByteArray value(QByteArrayView key) const;
+
+        //!
+        //! \brief values
+        //! \return all values of header with given key
+        QList<QByteArray> values(QByteArrayView key) const;
+
+        bool contains(QByteArrayView key) const;
+
+        //!
+        //! \brief add
+        //! append value to header with given key
+        void add(QByteArrayView key, QByteArrayView value);
+
+        //!
+        //! \brief set
+        //! replace all values of header with given key
+        void set(QByteArrayView key, QByteArrayView value);
+
+        void remove(QByteArrayView key);
+
+        //!
+        //! \brief toByteArray
+        //! \return headers serialized for HPUB, received headers are returned as is
+        QByteArray toByteArray() const;
+
+        //!
+        //! \brief detach
+        //! make deep copy of data still referencing the read buffer
+        void detach();
+
+    private:
+
+        void parse() const;
+        void modify();
+
+        struct Entry
+        {
+            QByteArray key;
+            QByteArray value;
+        };
+
+        //!
+        //! \brief m_raw
+        //! header block as received, may reference read buffer
+        QByteArray m_raw;
+
+        //!
+        //! \brief m_entries
+        //! parsed entries, reference m_raw until headers are modified
+        mutable QList<Entry> m_entries;
+        mutable int m_status = 0;
+        mutable QByteArray m_description;
+        mutable bool m_parsed = false;
+
+        //!
+        //! \brief m_modified
+        //! entries own their data and m_raw is no longer valid
+        bool m_modified = false;
+    };
+
+    //!
+    //! \brief detach_raw
+    //! copy data referencing foreign memory (QByteArray::fromRawData), shared data is left as is
+    inline void detach_raw(QByteArray &data)
+    {
+        if(!data.isEmpty() && !data.data_ptr().isMutable())
+            data = QByteArray(data.constData(), data.size());
+    }
+
+    //!
+    //! \brief The Message struct
+    //! message delivered to binary-safe callbacks
+    //! members may share memory with the read buffer and are only valid during the callback,
+    //! call detach() on message that is kept after the callback returns
+    struct Message
+    {
+        QByteArray subject;
+        QByteArray reply;
+        QByteArray payload;
+        Headers headers;
+        uint64_t ssid = 0;
+
+        //!
+        //! \brief detach
+        //! make deep copy of data still referencing the read buffer
+        void detach()
+        {
+            detach_raw(subject);
+            detach_raw(reply);
+            detach_raw(payload);
+            headers.detach();
+        }
+    };
+
+    //! main callback message
+    using MessageCallback = std::function<void(QString &&message, QString &&inbox, QString &&subject)>;
+    using MessageHandler = std::function<void(const Nats::Message &message)>;
+    using ConnectCallback = std::function<void()>;
+    using FlushCallback = std::function<void()>;
+    using ErrorCallback = std::function<void(const QString &error)>;
+    using RepliesHandler = std::function<void(const QList<Nats::Message> &replies)>;
+
+    //!
+    //! \brief The BatchMessage struct
+    //! message of Client::publishBatch, data has to stay valid only during the call
+    struct BatchMessage
+    {
+        QByteArrayView subject;
+        QByteArrayView payload;
+        QByteArrayView reply;
+    };
+
+    //!
+    //! \brief append_number
+    //! append decimal representation of value to buffer without temporary allocations
+    inline void append_number(QByteArray &buffer, uint64_t value)
+    {
+        char digits[20];
+        int count = 0;
+
+        do
+        {
+            digits[sizeof(digits) - 1 - count++] = char('0' + value % 10);
+            value /= 10;
+        } while(value != 0);
+
+        buffer.append(digits + sizeof(digits) - count, count);
+    }
+
+    //!
+    //! \brief number_length
+    //! \return number of decimal digits of value
+    inline qsizetype number_length(uint64_t value)
+    {
+        qsizetype length = 1;
+        while(value >= 10)
+        {
+            value /= 10;
+            ++length;
+        }
+
+        return length;
+    }
+
+    //!
+    //! \brief append_pub
+    //! serialize PUB frame, 'PUB <subject> [reply-to] <#bytes>\r\n[payload]\r\n'
+    inline void append_pub(QByteArray &buffer, QByteArrayView subject, QByteArrayView payload, QByteArrayView reply)
+    {
+        buffer.append("PUB ", 4);
+        buffer.append(subject.data(), subject.size());
+        buffer.append(' ');
+
+        if(!reply.isEmpty())
+        {
+            buffer.append(reply.data(), reply.size());
+            buffer.append(' ');
+        }
+
+        append_number(buffer, uint64_t(payload.size()));
+        buffer.append("\r\n", 2);
+        buffer.append(payload.data(), payload.size());
+        buffer.append("\r\n", 2);
+    }
+
+    //!
+    //! \brief is_valid_subject
+    //! \return true if subject has no empty tokens or whitespace, wildcards '*' and '>' are only
+    //! allowed as whole tokens when subscribing, '>' being the last one
+    inline bool is_valid_subject(QByteArrayView subject, bool wildcards = false)
+    {
+        if(subject.isEmpty())
+            return false;
+
+        qsizetype start = 0;
+
+        for(qsizetype i = 0; i <= subject.size(); ++i)
+        {
+            const char c = (i < subject.size()) ? subject[i] : '.';
+
+            if(c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                return false;
+
+            if(c != '.')
+                continue;
+
+            const QByteArrayView token = subject.sliced(start, i - start);
+            if(token.isEmpty())
+                return false;
+
+            if(token.contains('*') || token.contains('>'))
+            {
+                if(!wildcards || token.size() != 1 || (token == ">" && i != subject.size()))
+                    return false;
+            }
+
+            start = i + 1;
+        }
+
+        return true;
+    }
+
+    //!
+    //! \brief append_hpub
+    //! serialize HPUB frame, 'HPUB <subject> [reply-to] <#header bytes> <#total bytes>\r\n[headers][payload]\r\n'
+    inline void append_hpub(QByteArray &buffer, QByteArrayView subject, QByteArrayView headers, QByteArrayView payload, QByteArrayView reply)
+    {
+        buffer.append("HPUB ", 5);
+        buffer.append(subject.data(), subject.size());
+        buffer.append(' ');
+
+        if(!reply.isEmpty())
+        {
+            buffer.append(reply.data(), reply.size());
+            buffer.append(' ');
+        }
+
+        append_number(buffer, uint64_t(headers.size()));
+        buffer.append(' ');
+        append_number(buffer, uint64_t(headers.size() + payload.size()));
+        buffer.append("\r\n", 2);
+        buffer.append(headers.data(), headers.size());
+        buffer.append(payload.data(), payload.size());
+        buffer.append("\r\n", 2);
+    }
+
+    inline bool Headers::isEmpty() const
+    {
+        if(!m_modified)
+            return m_raw.isEmpty();
+
+        return m_entries.isEmpty() && m_status == 0;
+    }
+
+    inline int Headers::status() const
+    {
+        parse();
+        return m_status;
+    }
+
+    inline QByteArray Headers::description() const
+    {
+        parse();
+        return m_description;
+    }
+
+    inline QByteArray Headers::value(QByteArrayView key) const
+    {
+        parse();
+
+        for(const Entry &entry : std::as_const(m_entries))
+        {
+            if(QByteArrayView(entry.key).compare(key, Qt::CaseInsensitive) == 0)
+                return entry.value;
+        }
+
+        return QByteArray();
+    }
+
+    inline QList<QByteArray> Headers::values(QByteArrayView key) const
+    {
+        parse();
+
+        QList<QByteArray> result;
+        for(const Entry &entry : std::as_const(m_entries))
+        {
+            if(QByteArrayView(entry.key).compare(key, Qt::CaseInsensitive) == 0)
+                result.append(entry.value);
+        }
+
+        return result;
+    }
+
+    inline bool Headers::contains(QByteArrayView key) const
+    {
+        parse();
+
+        for(const Entry &entry : std::as_const(m_entries))
+        {
+            if(QByteArrayView(entry.key).compare(key, Qt::CaseInsensitive) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    inline void Headers::add(QByteArrayView key, QByteArrayView value)
+    {
+        modify();
+        m_entries.append(Entry{key.toByteArray(), value.toByteArray()});
+    }
+
+    inline void Headers::set(QByteArrayView key, QByteArrayView value)
+    {
+        remove(key);
+        m_entries.append(Entry{key.toByteArray(), value.toByteArray()});
+    }
+
+    inline void Headers::remove(QByteArrayView key)
+    {
+        modify();
+        m_entries.removeIf([key](const Entry &entry)
+        {
+            return QByteArrayView(entry.key).compare(key, Qt::CaseInsensitive) == 0;
+        });
+    }
+
+    inline QByteArray Headers::toByteArray() const
+    {
+        if(!m_modified)
+            return m_raw;
+
+        QByteArray buffer;
+        buffer.reserve(12 + m_description.size() + m_entries.size() * 32);
+        buffer.append("NATS/1.0", 8);
+
+        if(m_status > 0)
+        {
+            buffer.append(' ');
+            append_number(buffer, uint64_t(m_status));
+
+            if(!m_description.isEmpty())
+            {
+                buffer.append(' ');
+                buffer.append(m_description);
+            }
+        }
+
+        buffer.append("\r\n", 2);
+
+        for(const Entry &entry : std::as_const(m_entries))
+        {
+            buffer.append(entry.key);
+            buffer.append(": ", 2);
+            buffer.append(entry.value);
+            buffer.append("\r\n", 2);
+        }
+
+        buffer.append("\r\n", 2);
+
+        return buffer;
+    }
+
+    inline void Headers::detach()
+    {
+        if(m_modified || m_raw.isEmpty() || m_raw.data_ptr().isMutable())
+            return;
+
+        // parsed entries point into old buffer, parse again on next access
+        detach_raw(m_raw);
+        m_entries.clear();
+        m_description.clear();
+        m_status = 0;
+        m_parsed = false;
+    }
+
+    inline void Headers::modify()
+    {
+        if(m_modified)
+            return;
+
+        parse();
+
+        // take ownership of everything before raw block goes away
+        for(Entry &entry : m_entries)
+        {
+            entry.key = QByteArray(entry.key.constData(), entry.key.size());
+            entry.value = QByteArray(entry.value.constData(), entry.value.size());
+        }
+
+        m_description = QByteArray(m_description.constData(), m_description.size());
+        m_raw.clear();
+        m_modified = true;
+    }
+
+    // NATS/1.0[ <status>[ <description>]]\r\n followed by '<key>: <value>\r\n' lines and empty line
+    inline void Headers::parse() const
+    {
+        if(m_parsed || m_modified)
+            return;
+
+        m_parsed = true;
+
+        const char *data = m_raw.constData();
+        const qsizetype size = m_raw.size();
+
+        auto trimmed = [data](qsizetype begin, qsizetype end)
+        {
+            while(begin < end && (data[begin] == ' ' || data[begin] == '\t'))
+                ++begin;
+            while(end > begin && (data[end - 1] == ' ' || data[end - 1] == '\t'))
+                --end;
+
+            return QByteArray::fromRawData(data + begin, end - begin);
+        };
+
+        qsizetype start = 0;
+        bool first = true;
+
+        while(start < size)
+        {
+            qsizetype end = start;
+            while(end < size && data[end] != '\r' && data[end] != '\n')
+                ++end;
+
+            if(first)
+            {
+                first = false;
+
+                // version line, status is three digits after version
+                qsizetype i = start;
+                while(i < end && data[i] != ' ')
+                    ++i;
+                while(i < end && data[i] == ' ')
+                    ++i;
+
+                auto digit = [data](qsizetype at) { return data[at] >= '0' && data[at] <= '9'; };
+
+                if(end - i >= 3 && digit(i) && digit(i + 1) && digit(i + 2))
+                {
+                    m_status = (data[i] - '0') * 100 + (data[i + 1] - '0') * 10 + (data[i + 2] - '0');
+                    m_description = trimmed(i + 3, end);
+                }
+            }
+            else if(end == start)
+            {
+                break;
+            }
+            else
+            {
+                qsizetype colon = start;
+                while(colon < end && data[colon] != ':')
+                    ++colon;
+
+                if(colon < end)
+                    m_entries.append(Entry{trimmed(start, colon), trimmed(colon + 1, end)});
+            }
+
+            // skip line terminator
+            if(end < size && data[end] == '\r')
+                ++end;
+            if(end < size && data[end] == '\n')
+                ++end;
+
+            start = end;
+        }
+    }
+
+    //!
+    //! \brief The MpscQueue class
+    //! lock-free intrusive multi-producer single-consumer queue (Vyukov)
+    //! any thread can push, only one thread may pop
+    class MpscQueue
+    {
+    public:
+        struct Node
+        {
+            std::atomic<Node *> next{nullptr};
+            QByteArray data;
+        };
+
+        MpscQueue() : m_head(&m_stub), m_tail(&m_stub)
+        {
+        }
+
+        ~MpscQueue()
+        {
+            while(Node *node = pop())
+                delete node;
+        }
+
+        MpscQueue(const MpscQueue &) = delete;
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        //!
+        //! \brief push
+        //! takes ownership of node, wait-free
+        void push(Node *node)
+        {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            Node *previous = m_head.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        //!
+        //! \brief pop
+        //! \return oldest node owned by caller or nullptr if queue is empty,
+        //! may also return nullptr while a push is in progress
+        Node *pop()
+        {
+            Node *tail = m_tail;
+            Node *next = tail->next.load(std::memory_order_acquire);
+
+            if(tail == &m_stub)
+            {
+                if(!next)
+                    return nullptr;
+
+                m_tail = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+
+            if(next)
+            {
+                m_tail = next;
+                return tail;
+            }
+
+            if(tail != m_head.load(std::memory_order_acquire))
+                return nullptr;
+
+            push(&m_stub);
+
+            next = tail->next.load(std::memory_order_acquire);
+            if(next)
+            {
+                m_tail = next;
+                return tail;
+            }
+
+            return nullptr;
+        }
+
+    private:
+        std::atomic<Node *> m_head;
+        Node *m_tail;
+        Node m_stub;
+    };
+
+    //!
+    //! \brief The Nuid class
+    //! fast unique id generator compatible with NATS NUID, used for inboxes
+    //! id is 12 crypto-random base62 characters followed by 10 character sequence
+    //! incremented by a random step, prefix is renewed when sequence overflows
+    class Nuid
+    {
+    public:
+        static constexpr int length = 22;
+
+        Nuid()
+        {
+            randomize_prefix();
+            reset_sequential();
+        }
+
+        //!
+        //! \brief next
+        //! \return next unique id
+        QByteArray next()
+        {
+            QByteArray id(length, Qt::Uninitialized);
+            next(id.data());
+
+            return id;
+        }
+
+        //!
+        //! \brief next
+        //! \param buffer
+        //! write next unique id to buffer which must hold at least 'length' bytes
+        void next(char *buffer)
+        {
+            m_seq += m_inc;
+            if(m_seq >= max_seq)
+            {
+                randomize_prefix();
+                reset_sequential();
+            }
+
+            memcpy(buffer, m_prefix, prefix_length);
+
+            int64_t seq = m_seq;
+            for(int i = length - 1; i >= prefix_length; --i)
+            {
+                buffer[i] = digits[seq % base];
+                seq /= base;
+            }
+        }
+
+    private:
+        static constexpr char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        static constexpr int base = 62;
+        static constexpr int prefix_length = 12;
+        static constexpr int64_t max_seq = 839299365868340224LL; // base^10
+        static constexpr int64_t min_inc = 33;
+        static constexpr int64_t max_inc = 333;
+
+        char m_prefix[prefix_length];
+        int64_t m_seq = 0;
+        int64_t m_inc = 0;
+
+        void randomize_prefix()
+        {
+            QRandomGenerator *generator = QRandomGenerator::system();
+            for(char &c : m_prefix)
+                c = digits[generator->bounded(base)];
+        }
+
+        void reset_sequential()
+        {
+            QRandomGenerator *generator = QRandomGenerator::global();
+            m_seq = generator->bounded(qint64(max_seq));
+            m_inc = min_inc + generator->bounded(int(max_inc - min_inc));
+        }
+    };
+
+    //!
+    //! \brief The Sublist class
+    //! subject trie matching literal subjects against subjects with '*' and '>' wildcards in O(tokens)
+    //! match results are cached per subject and kept up to date on insert and remove
+    class Sublist
+    {
+    public:
+        //! cached match results, arbitrary entry is evicted when full
+        static constexpr qsizetype max_cache = 1024;
+
+        //!
+        //! \brief insert
+        //! \return false if subject is not valid, like empty token or '>' not being last
+        bool insert(QByteArrayView subject, uint64_t id);
+
+        //!
+        //! \brief remove
+        //! \return false if subject with given id was not inserted
+        bool remove(QByteArrayView subject, uint64_t id);
+
+        //!
+        //! \brief match
+        //! \return ids inserted with subjects matching given literal subject
+        QList<uint64_t> match(const QByteArray &subject);
+
+        //!
+        //! \brief count
+        //! \return number of inserted ids
+        qsizetype count() const;
+
+        //!
+        //! \brief matches
+        //! \return true if literal subject matches subject with wildcards
+        static bool matches(QByteArrayView pattern, QByteArrayView subject);
+
+    private:
+
+        struct Node
+        {
+            //! ids of subjects ending at this node
+            QList<uint64_t> ids;
+            QHash<QByteArray, std::shared_ptr<Node>> literals;
+
+            //! '*' and '>' children
+            std::shared_ptr<Node> pwc;
+            std::shared_ptr<Node> fwc;
+
+            bool isEmpty() const
+            {
+                return ids.isEmpty() && literals.isEmpty() && !pwc && !fwc;
+            }
+        };
+
+        using Tokens = QVarLengthArray<QByteArrayView, 16>;
+
+        static bool tokenize(QByteArrayView subject, Tokens &tokens);
+        static void collect(const Node &node, const Tokens &tokens, qsizetype index, QList<uint64_t> &result);
+        static bool remove(Node &node, const Tokens &tokens, qsizetype index, uint64_t id);
+
+        //!
+        //! \brief m_root
+        Node m_root;
+
+        //!
+        //! \brief m_cache
+        //! match results by literal subject
+        QHash<QByteArray, QList<uint64_t>> m_cache;
+
+        //!
+        //! \brief m_count
+        qsizetype m_count = 0;
+    };
+
+    inline bool Sublist::tokenize(QByteArrayView subject, Tokens &tokens)
+    {
+        qsizetype start = 0;
+
+        for(qsizetype i = 0; i <= subject.size(); ++i)
+        {
+            if(i < subject.size() && subject[i] != '.')
+                continue;
+
+            if(i == start)
+                return false;
+
+            tokens.append(subject.sliced(start, i - start));
+            start = i + 1;
+        }
+
+        return true;
+    }
+
+    inline bool Sublist::insert(QByteArrayView subject, uint64_t id)
+    {
+        Tokens tokens;
+        if(!tokenize(subject, tokens))
+            return false;
+
+        for(qsizetype i = 0; i < tokens.size() - 1; ++i)
+        {
+            if(tokens[i] == ">")
+                return false;
+        }
+
+        Node *node = &m_root;
+
+        for(const QByteArrayView token : std::as_const(tokens))
+        {
+            std::shared_ptr<Node> &child = (token == ">") ? node->fwc
+                                         : (token == "*") ? node->pwc
+                                         : node->literals[token.toByteArray()];
+            if(!child)
+                child = std::make_shared<Node>();
+
+            node = child.get();
+        }
+
+        node->ids.append(id);
+        m_count++;
+
+        // cached subjects gaining new match
+        for(auto it = m_cache.begin(); it != m_cache.end(); ++it)
+        {
+            if(matches(subject, it.key()))
+                it.value().append(id);
+        }
+
+        return true;
+    }
+
+    inline bool Sublist::remove(QByteArrayView subject, uint64_t id)
+    {
+        Tokens tokens;
+        if(!tokenize(subject, tokens) || !remove(m_root, tokens, 0, id))
+            return false;
+
+        m_count--;
+
+        for(auto it = m_cache.begin(); it != m_cache.end(); ++it)
+        {
+            if(matches(subject, it.key()))
+                it.value().removeOne(id);
+        }
+
+        return true;
+    }
+
+    // empty nodes are pruned on the way back
+    inline bool Sublist::remove(Node &node, const Tokens &tokens, qsizetype index, uint64_t id)
+    {
+        if(index == tokens.size())
+            return node.ids.removeOne(id);
+
+        const QByteArrayView token = tokens[index];
+
+        if(token == ">" || token == "*")
+        {
+            std::shared_ptr<Node> &child = (token == ">") ? node.fwc : node.pwc;
+            if(!child || !remove(*child, tokens, index + 1, id))
+                return false;
+
+            if(child->isEmpty())
+                child.reset();
+
+            return true;
+        }
+
+        auto it = node.literals.find(QByteArray::fromRawData(token.data(), token.size()));
+        if(it == node.literals.end() || !remove(**it, tokens, index + 1, id))
+            return false;
+
+        if((*it)->isEmpty())
+            node.literals.erase(it);
+
+        return true;
+    }
+
+    inline QList<uint64_t> Sublist::match(const QByteArray &subject)
+    {
+        auto cached = m_cache.constFind(subject);
+        if(cached != m_cache.constEnd())
+            return cached.value();
+
+        QList<uint64_t> result;
+
+        Tokens tokens;
+        if(tokenize(subject, tokens))
+            collect(m_root, tokens, 0, result);
+
+        if(m_cache.size() >= max_cache)
+            m_cache.erase(m_cache.begin());
+
+        // subject may reference read buffer
+        m_cache.insert(QByteArray(subject.constData(), subject.size()), result);
+
+        return result;
+    }
+
+    inline void Sublist::collect(const Node &node, const Tokens &tokens, qsizetype index, QList<uint64_t> &result)
+    {
+        if(index == tokens.size())
+        {
+            result.append(node.ids);
+            return;
+        }
+
+        // '>' matches one or more remaining tokens
+        if(node.fwc)
+            result.append(node.fwc->ids);
+
+        auto it = node.literals.constFind(QByteArray::fromRawData(tokens[index].data(), tokens[index].size()));
+        if(it != node.literals.constEnd())
+            collect(**it, tokens, index + 1, result);
+
+        if(node.pwc)
+            collect(*node.pwc, tokens, index + 1, result);
+    }
+
+    inline qsizetype Sublist::count() const
+    {
+        return m_count;
+    }
+
+    inline bool Sublist::matches(QByteArrayView pattern, QByteArrayView subject)
+    {
+        Tokens pattern_tokens;
+        Tokens subject_tokens;
+
+        if(!tokenize(pattern, pattern_tokens) || !tokenize(subject, subject_tokens))
+            return false;
+
+        for(qsizetype i = 0; i < pattern_tokens.size(); ++i)
+        {
+            if(pattern_tokens[i] == ">")
+                return subject_tokens.size() > i;
+
+            if(i >= subject_tokens.size())
+                return false;
+
+            if(pattern_tokens[i] != "*" && pattern_tokens[i] != subject_tokens[i])
+                return false;
+        }
+
+        return pattern_tokens.size() == subject_tokens.size();
+    }
+
+    //!
+    //! \brief The Histogram class
+    //! log-linear histogram (HDR style) of latencies in microseconds, 16 buckets per power of two,
+    //! so values are recorded with ~6% precision over whole range
+    //! recording is wait-free with relaxed atomics, copy is a snapshot
+    class Histogram
+    {
+    public:
+        static constexpr int sub_bucket_bits = 5;
+        static constexpr int half_bucket = 1 << (sub_bucket_bits - 1);
+        static constexpr int bucket_count = (65 - sub_bucket_bits) * half_bucket;
+
+        Histogram() = default;
+
+        Histogram(const Histogram &other)
+        {
+            *this = other;
+        }
+
+        Histogram &operator=(const Histogram &other)
+        {
+            for(int i = 0; i < bucket_count; ++i)
+                m_buckets[i].store(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            m_count.store(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_sum.store(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_max.store(other.m_max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            return *this;
+        }
+
+        void record(qint64 value)
+        {
+            value = qMax<qint64>(value, 0);
+
+            m_buckets[index(value)].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_sum.fetch_add(quint64(value), std::memory_order_relaxed);
+
+            qint64 max = m_max.load(std::memory_order_relaxed);
+            while(value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        //!
+        //! \brief merge
+        //! add values recorded by other histogram
+        void merge(const Histogram &other)
+        {
+            for(int i = 0; i < bucket_count; ++i)
+                m_buckets[i].fetch_add(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            m_count.fetch_add(other.count(), std::memory_order_relaxed);
+            m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            const qint64 other_max = other.max();
+            qint64 max = m_max.load(std::memory_order_relaxed);
+            while(other_max > max && !m_max.compare_exchange_weak(max, other_max, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        quint64 count() const
+        {
+            return m_count.load(std::memory_order_relaxed);
+        }
+
+        qint64 max() const
+        {
+            return m_max.load(std::memory_order_relaxed);
+        }
+
+        double mean() const
+        {
+            const quint64 total = count();
+            return total == 0 ? 0.0 : double(m_sum.load(std::memory_order_relaxed)) / double(total);
+        }
+
+        //!
+        //! \brief percentile
+        //! \param percentile 0 - 100
+        //! \return upper bound of bucket holding given percentile, 0 if nothing was recorded
+        qint64 percentile(double percentile) const
+        {
+            const quint64 total = count();
+            if(total == 0)
+                return 0;
+
+            const quint64 target = qMax<quint64>(1, quint64(double(total) * qBound(0.0, percentile, 100.0) / 100.0 + 0.5));
+            quint64 seen = 0;
+
+            for(int i = 0; i < bucket_count; ++i)
+            {
+                seen += m_buckets[i].load(std::memory_order_relaxed);
+                if(seen >= target)
+                    return qMin(upper_bound(i), max());
+            }
+
+            return max();
+        }
+
+    private:
+
+        // first 2 * half_bucket values are exact, then each power of two gets half_bucket buckets
+        static int index(qint64 value)
+        {
+            int msb = 0;
+            for(quint64 v = quint64(value) >> 1; v != 0; v >>= 1)
+                ++msb;
+
+            const int magnitude = qMax(0, msb - sub_bucket_bits + 1);
+            return magnitude * half_bucket + int(value >> magnitude);
+        }
+
+        static qint64 upper_bound(int index)
+        {
+            const int magnitude = qMax(0, index / half_bucket - 1);
+            const quint64 sub_bucket = quint64(index - magnitude * half_bucket);
+
+            return qint64(((sub_bucket + 1) << magnitude) - 1);
+        }
+
+        std::atomic<quint64> m_buckets[bucket_count] = {};
+        std::atomic<quint64> m_count{0};
+        std::atomic<quint64> m_sum{0};
+        std::atomic<qint64> m_max{0};
+    };
+
+    //!
+    //! \brief The SubscriptionStatistics struct
+    struct SubscriptionStatistics
+    {
+        uint64_t ssid = 0;
+        QByteArray subject;
+        QByteArray queue;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        qint64 pending_msgs = 0;
+        qint64 pending_bytes = 0;
+    };
+
+    //!
+    //! \brief The Statistics struct
+    //! snapshot of client counters, message counts cover payload bytes only
+    struct Statistics
+    {
+        quint64 in_msgs = 0;
+        quint64 in_bytes = 0;
+        quint64 out_msgs = 0;
+        quint64 out_bytes = 0;
+        quint64 reconnects = 0;
+        quint64 parse_errors = 0;
+
+        //! largest amount of output waiting to be written to socket
+        qint64 max_buffered_bytes = 0;
+
+        //! only filled when snapshot is taken on client thread
+        QList<SubscriptionStatistics> subscriptions;
+
+        //! request round trips and client thread callback execution (us), with Options::latency_histograms
+        Histogram request_latency;
+        Histogram callback_latency;
+    };
+
+    //!
+    //! \brief The Options struct
+    //! holds all client options
+    struct Options
+    {
+        bool verbose = false;
+        bool pedantic = false;
+        bool ssl_required = false;
+        bool ssl = false;
+        bool ssl_verify = true;
+        QString ssl_key;
+        QString ssl_cert;
+        QString ssl_ca;
+        QString name = "qt-nats";
+        inline static const QString lang = QStringLiteral("cpp");
+        inline static const QString version = QStringLiteral("1.0.0");
+        QString user;
+        QString pass;
+        QString token;
+
+        //! pending output is written to socket once per event loop iteration
+        //! or as soon as it grows over this many bytes
+        int flush_threshold = 64 * 1024;
+
+        //! additional servers, 'host:port' or 'nats://host:port', used when connection is lost
+        QStringList servers;
+
+        //! reconnect to server pool when established connection is lost
+        bool allow_reconnect = true;
+
+        //! reconnect attempts per server before it is dropped from the pool, -1 for no limit
+        int max_reconnect_attempts = 60;
+
+        //! delay before reconnect attempt (ms), doubled with each failed attempt up to max_reconnect_wait
+        //! first attempt after connection is lost is made immediately
+        int reconnect_wait = 500;
+        int max_reconnect_wait = 30000;
+
+        //! random delay up to this many ms added to each reconnect attempt
+        int reconnect_jitter = 100;
+
+        //! connection attempt, including INFO and TLS handshake, is aborted after this many ms, 0 to wait for the OS
+        int connect_timeout = 2000;
+
+        //! bytes of publishes buffered while reconnecting, publishes over the limit are dropped
+        int reconnect_buffer_size = 8 * 1024 * 1024;
+
+        //! do not add servers advertised by the cluster in INFO 'connect_urls' to the pool
+        bool ignore_discovered_servers = false;
+
+        //! interval of client PINGs (ms), 0 to disable
+        int ping_interval = 120000;
+
+        //! connection is considered stale and closed when this many PINGs are without PONG
+        int max_pings_out = 2;
+
+        //! default limits of messages received but not yet delivered to a subscription callback,
+        //! messages over the limit are dropped and slowConsumer signal is emitted, -1 for no limit
+        int pending_msgs_limit = 65536;
+        qint64 pending_bytes_limit = 64 * 1024 * 1024;
+
+        //! time (ms) callbacks may run in one pass before remaining messages are deferred
+        //! to next event loop iteration so the socket keeps being read
+        int dispatch_slice = 10;
+
+        //! bytes published from other threads waiting for client thread,
+        //! publishing threads block while the limit is exceeded
+        qint64 max_queued_bytes = 32 * 1024 * 1024;
+
+        //! minimum bytes read from socket at once into reusable read buffer, grown to max_payload
+        //! announced by server so largest message fits one read, frames bigger than it are
+        //! assembled by parser across reads
+        int read_buffer_size = 64 * 1024;
+
+        //! upper bound for read buffer grown from server max_payload
+        int max_read_buffer_size = 8 * 1024 * 1024;
+
+        //! record request round trips and callback execution times in Statistics histograms,
+        //! costs two clock reads per callback
+        bool latency_histograms = false;
+    };
+
+    //!
+    //! \brief The Subscription class
+    //! holds subscription data and emits signal when ready as alternative to callbacks
+    class Subscription : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit Subscription(QObject *parent = nullptr): QObject(parent) {}
+
+        //! last message, only set for received() signal
+        QString subject;
+        QString message;
+        QString inbox;
+        uint64_t ssid = 0;
+
+        //!
+        //! \brief available
+        //! \return number of queued messages
+        qsizetype available() const;
+
+        //!
+        //! \brief takeAll
+        //! \return all queued messages, oldest first
+        QList<Nats::Message> takeAll();
+
+        //!
+        //! \brief next
+        //! \param message
+        //! \return false if there is no queued message
+        bool next(Nats::Message &message);
+
+    signals:
+
+        //!
+        //! \brief received
+        //! emitted for each message with message fields set, only when connected
+        void received();
+
+        //!
+        //! \brief messagesAvailable
+        //! emitted once per event loop iteration in which messages were queued,
+        //! messages are queued only while this signal is connected, up to the subscription pending limits
+        void messagesAvailable();
+
+    private:
+        friend class Client;
+
+        void enqueue(const Message &message);
+
+        //!
+        //! \brief m_messages
+        //! messages waiting for takeAll() or next(), detached from read buffer
+        QQueue<Message> m_messages;
+        qint64 m_bytes = 0;
+
+        //!
+        //! \brief m_notify_scheduled
+        //! messagesAvailable() emit is queued
+        bool m_notify_scheduled = false;
+    };
+
+    inline qsizetype Subscription::available() const
+    {
+        return m_messages.size();
+    }
+
+    inline QList<Message> Subscription::takeAll()
+    {
+        m_bytes = 0;
+        return std::exchange(m_messages, QQueue<Message>());
+    }
+
+    inline bool Subscription::next(Message &message)
+    {
+        if(m_messages.isEmpty())
+            return false;
+
+        message = m_messages.dequeue();
+        m_bytes -= message.payload.size();
+        return true;
+    }
+
+    inline void Subscription::enqueue(const Message &message)
+    {
+        static const QMetaMethod received_signal = QMetaMethod::fromSignal(&Subscription::received);
+        static const QMetaMethod available_signal = QMetaMethod::fromSignal(&Subscription::messagesAvailable);
+
+        const bool legacy = isSignalConnected(received_signal);
+
+        // string conversions only for those who listen
+        if(legacy)
+        {
+            this->message = QString::fromUtf8(message.payload);
+            subject = QString::fromUtf8(message.subject);
+            inbox = QString::fromUtf8(message.reply);
+
+            emit received();
+        }
+
+        // nobody would ever take queued messages
+        if(!isSignalConnected(available_signal))
+            return;
+
+        Message queued = message;
+        queued.detach();
+        m_messages.enqueue(std::move(queued));
+        m_bytes += message.payload.size();
+
+        // one signal for everything received in this pass
+        if(m_notify_scheduled)
+            return;
+
+        m_notify_scheduled = true;
+        QMetaObject::invokeMethod(this, [this]
+        {
+            m_notify_scheduled = false;
+
+            if(!m_messages.isEmpty())
+                emit messagesAvailable();
+        }, Qt::QueuedConnection);
+    }
+
+    //!
+    //! \brief The MsgArg struct
+    //! arguments of a MSG or HMSG control line
+    //! subject and reply reference the read buffer unless the line was split between reads
+    struct MsgArg
+    {
+        QByteArray subject;
+        QByteArray reply;
+        uint64_t ssid = 0;
+
+        //! size of headers and payload together, headers come first
+        qsizetype size = 0;
+        qsizetype header_size = 0;
+    };
+
+    //!
+    //! \brief The Parser class
+    //! incremental protocol parser working directly on bytes read from the socket
+    //! state is kept between calls so operations can be split at any byte boundary
+    //! see http://nats.io/documentation/internals/nats-protocol
+    class Parser
+    {
+    public:
+
+        //!
+        //! \brief The Handler class
+        //! receives operations as they are parsed
+        //! payload and arguments are only valid for the duration of the call
+        class Handler
+        {
+        public:
+            virtual ~Handler() = default;
+
+            virtual void process_msg(const MsgArg &args, const QByteArray &headers, const QByteArray &payload) = 0;
+            virtual void process_ping() = 0;
+            virtual void process_pong() = 0;
+            virtual void process_ok() = 0;
+            virtual void process_err(QByteArrayView message) = 0;
+            virtual void process_info(QByteArrayView message) = 0;
+        };
+
+        //!
+        //! \brief parse
+        //! \param buffer
+        //! \param handler
+        //! \return false on protocol error, see error()
+        //! parse next chunk of data received from server
+        bool parse(const QByteArray &buffer, Handler &handler);
+
+        //!
+        //! \brief reset
+        //! discard any partially parsed operation, used when connection is (re)established
+        void reset();
+
+        //!
+        //! \brief error
+        //! description of the last protocol error
+        const QString &error() const
+        {
+            return m_error;
+        }
+
+        //!
+        //! \brief parse_uint
+        //! \param value
+        //! \return parsed number or -1 if value is not a valid unsigned integer
+        static int64_t parse_uint(QByteArrayView value);
+
+        //!
+        //! \brief setMaxPayload
+        //! frames announcing more than max bytes are rejected before anything is buffered, 0 for no limit
+        void setMaxPayload(qsizetype max)
+        {
+            m_max_payload = max;
+        }
+
+        //!
+        //! \brief setMaxReserve
+        //! split payload buffer is reserved up front only up to max bytes while max_payload is not known,
+        //! bigger payloads grow with the data that actually arrives
+        void setMaxReserve(qsizetype max)
+        {
+            m_max_reserve = max;
+        }
+
+    private:
+
+        enum State
+        {
+            OP_START,
+            OP_PLUS,
+            OP_PLUS_O,
+            OP_PLUS_OK,
+            OP_MINUS,
+            OP_MINUS_E,
+            OP_MINUS_ER,
+            OP_MINUS_ERR,
+            OP_MINUS_ERR_SPC,
+            MINUS_ERR_ARG,
+            OP_H,
+            OP_M,
+            OP_MS,
+            OP_MSG,
+            OP_MSG_SPC,
+            MSG_ARG,
+            MSG_PAYLOAD,
+            MSG_END,
+            OP_P,
+            OP_PI,
+            OP_PIN,
+            OP_PING,
+            OP_PO,
+            OP_PON,
+            OP_PONG,
+            OP_I,
+            OP_IN,
+            OP_INF,
+            OP_INFO,
+            OP_INFO_SPC,
+            INFO_ARG
+        };
+
+        State m_state = OP_START;
+
+        //!
+        //! \brief m_as
+        //! start of current argument inside the buffer being parsed
+        qsizetype m_as = 0;
+
+        //!
+        //! \brief m_drop
+        //! number of trailing bytes ('\r') to drop from current argument
+        qsizetype m_drop = 0;
+
+        //!
+        //! \brief m_arg_buf
+        //! holds control line split between two reads, only used when m_split_arg is set
+        QByteArray m_arg_buf;
+        bool m_split_arg = false;
+
+        //!
+        //! \brief m_msg_buf
+        //! holds payload split between two reads, only used when m_split_msg is set
+        QByteArray m_msg_buf;
+        bool m_split_msg = false;
+
+        //!
+        //! \brief m_msg_arg
+        //! arguments of MSG currently being parsed
+        MsgArg m_msg_arg;
+        bool m_msg_arg_owned = false;
+
+        //!
+        //! \brief m_header
+        //! current operation is HMSG
+        bool m_header = false;
+
+        //!
+        //! \brief m_max_payload
+        //! max_payload announced by server
+        qsizetype m_max_payload = 0;
+        qsizetype m_max_reserve = 8 * 1024 * 1024;
+
+        QString m_error;
+
+        bool process_msg_args(QByteArrayView arg, bool copy);
+        bool parse_error(const char *buffer, qsizetype length, qsizetype position);
+
+        //!
+        //! \brief argument
+        //! current argument, either from the buffer or from the split argument storage
+        QByteArrayView argument(const char *buffer, qsizetype position) const
+        {
+            if(m_split_arg)
+                return QByteArrayView(m_arg_buf);
+
+            return QByteArrayView(buffer + m_as, position - m_drop - m_as);
+        }
+    };
+
+    inline void Parser::reset()
+    {
+        m_state = OP_START;
+        m_as = 0;
+        m_drop = 0;
+        m_arg_buf.clear();
+        m_split_arg = false;
+        m_msg_buf.clear();
+        m_split_msg = false;
+        m_msg_arg = MsgArg();
+        m_msg_arg_owned = false;
+        m_header = false;
+    }
+
+    inline int64_t Parser::parse_uint(QByteArrayView value)
+    {
+        if(value.isEmpty() || value.size() > 18)
+            return -1;
+
+        int64_t result = 0;
+        for(const char c : value)
+        {
+            if(c < '0' || c > '9')
+                return -1;
+
+            result = result * 10 + (c - '0');
+        }
+
+        return result;
+    }
+
+    inline bool Parser::parse_error(const char *buffer, qsizetype length, qsizetype position)
+    {
+        m_error = QStringLiteral("parse error: state=%1, buffer=%2")
+                .arg(m_state)
+                .arg(QString::fromUtf8(buffer + position, qMin<qsizetype>(length - position, 32)));
+
+        reset();
+
+        return false;
+    }
+
+    // MSG arguments are '<subject> <sid> [reply-to] <#bytes>'
+    // HMSG arguments are '<subject> <sid> [reply-to] <#header bytes> <#total bytes>'
+    inline bool Parser::process_msg_args(QByteArrayView arg, bool copy)
+    {
+        const int max_parts = m_header ? 5 : 4;
+        QByteArrayView parts[5];
+        int count = 0;
+        qsizetype start = -1;
+
+        for(qsizetype i = 0; i <= arg.size(); ++i)
+        {
+            const bool separator = (i == arg.size() || arg[i] == ' ' || arg[i] == '\t' || arg[i] == '\r');
+
+            if(!separator)
+            {
+                if(start < 0)
+                    start = i;
+
+                continue;
+            }
+
+            if(start < 0)
+                continue;
+
+            if(count == max_parts)
+                return false;
+
+            parts[count++] = QByteArrayView(arg.data() + start, i - start);
+            start = -1;
+        }
+
+        // reply is optional, headers size is present only in HMSG
+        const int required = m_header ? 4 : 3;
+        if(count < required)
+            return false;
+
+        const bool has_reply = (count == max_parts);
+
+        QByteArrayView subject = parts[0];
+        QByteArrayView reply = has_reply ? parts[2] : QByteArrayView();
+        QByteArrayView size = parts[count - 1];
+        QByteArrayView header_size = m_header ? parts[count - 2] : QByteArrayView("0");
+
+        const int64_t ssid = parse_uint(parts[1]);
+        const int64_t message_size = parse_uint(size);
+        const int64_t headers_size = parse_uint(header_size);
+
+        if(ssid < 0 || message_size < 0 || headers_size < 0 || headers_size > message_size)
+            return false;
+
+        m_msg_arg.ssid = uint64_t(ssid);
+        m_msg_arg.size = qsizetype(message_size);
+        m_msg_arg.header_size = qsizetype(headers_size);
+
+        // arguments from split storage are copied because storage is reused for next line
+        if(copy)
+        {
+            m_msg_arg.subject = QByteArray(subject.data(), subject.size());
+            m_msg_arg.reply = QByteArray(reply.data(), reply.size());
+        }
+        else
+        {
+            m_msg_arg.subject = QByteArray::fromRawData(subject.data(), subject.size());
+            m_msg_arg.reply = QByteArray::fromRawData(reply.data(), reply.size());
+        }
+
+        m_msg_arg_owned = copy;
+
+        return true;
+    }
+
+    inline bool Parser::parse(const QByteArray &buffer, Handler &handler)
+    {
+        const char *buf = buffer.constData();
+        const qsizetype length = buffer.size();
+        qsizetype i = 0;
+
+        for(i = 0; i < length; ++i)
+        {
+            const char b = buf[i];
+
+            switch(m_state)
+            {
+                case OP_START:
+                    switch(b)
+                    {
+                        case 'M':
+                        case 'm':
+                            m_state = OP_M;
+                            m_header = false;
+                            break;
+                        case 'H':
+                        case 'h':
+                            m_state = OP_H;
+                            m_header = true;
+                            break;
+                        case 'P':
+                        case 'p':
+                            m_state = OP_P;
+                            break;
+                        case '+':
+                            m_state = OP_PLUS;
+                            break;
+                        case '-':
+                            m_state = OP_MINUS;
+                            break;
+                        case 'I':
+                        case 'i':
+                            m_state = OP_I;
+                            break;
+                        default:
+                            return parse_error(buf, length, i);
+                    }
+                    break;
+
+                case OP_H:
+                    if(b != 'M' && b != 'm')
+                        return parse_error(buf, length, i);
+                    m_state = OP_M;
+                    break;
+
+                case OP_M:
+                    if(b != 'S' && b != 's')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MS;
+                    break;
+
+                case OP_MS:
+                    if(b != 'G' && b != 'g')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MSG;
+                    break;
+
+                case OP_MSG:
+                    if(b != ' ' && b != '\t')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MSG_SPC;
+                    break;
+
+                case OP_MSG_SPC:
+                    if(b == ' ' || b == '\t')
+                        break;
+                    m_state = MSG_ARG;
+                    m_as = i;
+                    break;
+
+                case MSG_ARG:
+                    switch(b)
+                    {
+                        case '\r':
+                            m_drop = 1;
+                            break;
+                        case '\n':
+                            if(!process_msg_args(argument(buf, i), m_split_arg))
+                                return parse_error(buf, length, i);
+
+                            // oversized frame would be buffered whole when split
+                            if(m_max_payload > 0 && m_msg_arg.size > m_max_payload)
+                            {
+                                m_error = QStringLiteral("maximum payload exceeded: %1 > %2").arg(m_msg_arg.size).arg(m_max_payload);
+                                reset();
+                                return false;
+                            }
+
+                            // keep capacity for next split line
+                            m_arg_buf.resize(0);
+                            m_split_arg = false;
+                            m_drop = 0;
+                            m_as = i + 1;
+                            m_state = MSG_PAYLOAD;
+
+                            // jump over the payload, if it is not complete we fall out
+                            // of the loop and keep it as a split message
+                            i = m_as + m_msg_arg.size - 1;
+                            break;
+                        default:
+                            if(m_split_arg)
+                                m_arg_buf.append(b);
+                            break;
+                    }
+                    break;
+
+                case MSG_PAYLOAD:
+                    if(m_split_msg)
+                    {
+                        if(m_msg_buf.size() >= m_msg_arg.size)
+                        {
+                            // buffer is released right after, slices have to own their data
+                            const qsizetype header_size = m_msg_arg.header_size;
+                            if(header_size == 0)
+                                handler.process_msg(m_msg_arg, QByteArray(), m_msg_buf);
+                            else
+                                handler.process_msg(m_msg_arg, QByteArray(m_msg_buf.constData(), header_size),
+                                                    QByteArray(m_msg_buf.constData() + header_size, m_msg_arg.size - header_size));
+
+                            m_msg_buf.clear();
+                            m_split_msg = false;
+                            m_state = MSG_END;
+                        }
+                        else
+                        {
+                            // copy as much as we can and skip ahead
+                            const qsizetype to_copy = qMin(m_msg_arg.size - m_msg_buf.size(), length - i);
+                            m_msg_buf.append(buf + i, to_copy);
+                            i += to_copy - 1;
+                        }
+                    }
+                    else if(i - m_as >= m_msg_arg.size)
+                    {
+                        const qsizetype header_size = m_msg_arg.header_size;
+                        handler.process_msg(m_msg_arg, QByteArray::fromRawData(buf + m_as, header_size),
+                                            QByteArray::fromRawData(buf + m_as + header_size, m_msg_arg.size - header_size));
+                        m_state = MSG_END;
+                    }
+                    break;
+
+                case MSG_END:
+                    if(b == '\n')
+                    {
+                        m_drop = 0;
+                        m_as = i + 1;
+                        m_state = OP_START;
+                    }
+                    break;
+
+                case OP_PLUS:
+                    if(b != 'O' && b != 'o')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PLUS_O;
+                    break;
+
+                case OP_PLUS_O:
+                    if(b != 'K' && b != 'k')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PLUS_OK;
+                    break;
+
+                case OP_PLUS_OK:
+                    if(b == '\n')
+                    {
+                        handler.process_ok();
+                        m_drop = 0;
+                        m_state = OP_START;
+                    }
+                    break;
+
+                case OP_MINUS:
+                    if(b != 'E' && b != 'e')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MINUS_E;
+                    break;
+
+                case OP_MINUS_E:
+                    if(b != 'R' && b != 'r')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MINUS_ER;
+                    break;
+
+                case OP_MINUS_ER:
+                    if(b != 'R' && b != 'r')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MINUS_ERR;
+                    break;
+
+                case OP_MINUS_ERR:
+                    if(b != ' ' && b != '\t')
+                        return parse_error(buf, length, i);
+                    m_state = OP_MINUS_ERR_SPC;
+                    break;
+
+                case OP_MINUS_ERR_SPC:
+                    if(b == ' ' || b == '\t')
+                        break;
+                    m_state = MINUS_ERR_ARG;
+                    m_as = i;
+                    break;
+
+                case MINUS_ERR_ARG:
+                    switch(b)
+                    {
+                        case '\r':
+                            m_drop = 1;
+                            break;
+                        case '\n':
+                            handler.process_err(argument(buf, i));
+
+                            m_arg_buf.resize(0);
+                            m_split_arg = false;
+                            m_drop = 0;
+                            m_as = i + 1;
+                            m_state = OP_START;
+                            break;
+                        default:
+                            if(m_split_arg)
+                                m_arg_buf.append(b);
+                            break;
+                    }
+                    break;
+
+                case OP_P:
+                    switch(b)
+                    {
+                        case 'I':
+                        case 'i':
+                            m_state = OP_PI;
+                            break;
+                        case 'O':
+                        case 'o':
+                            m_state = OP_PO;
+                            break;
+                        default:
+                            return parse_error(buf, length, i);
+                    }
+                    break;
+
+                case OP_PI:
+                    if(b != 'N' && b != 'n')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PIN;
+                    break;
+
+                case OP_PIN:
+                    if(b != 'G' && b != 'g')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PING;
+                    break;
+
+                case OP_PING:
+                    if(b == '\n')
+                    {
+                        handler.process_ping();
+                        m_drop = 0;
+                        m_state = OP_START;
+                    }
+                    break;
+
+                case OP_PO:
+                    if(b != 'N' && b != 'n')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PON;
+                    break;
+
+                case OP_PON:
+                    if(b != 'G' && b != 'g')
+                        return parse_error(buf, length, i);
+                    m_state = OP_PONG;
+                    break;
+
+                case OP_PONG:
+                    if(b == '\n')
+                    {
+                        handler.process_pong();
+                        m_drop = 0;
+                        m_state = OP_START;
+                    }
+                    break;
+
+                case OP_I:
+                    if(b != 'N' && b != 'n')
+                        return parse_error(buf, length, i);
+                    m_state = OP_IN;
+                    break;
+
+                case OP_IN:
+                    if(b != 'F' && b != 'f')
+                        return parse_error(buf, length, i);
+                    m_state = OP_INF;
+                    break;
+
+                case OP_INF:
+                    if(b != 'O' && b != 'o')
+                        return parse_error(buf, length, i);
+                    m_state = OP_INFO;
+                    break;
+
+                case OP_INFO:
+                    if(b != ' ' && b != '\t')
+                        return parse_error(buf, length, i);
+                    m_state = OP_INFO_SPC;
+                    break;
+
+                case OP_INFO_SPC:
+                    if(b == ' ' || b == '\t')
+                        break;
+                    m_state = INFO_ARG;
+                    m_as = i;
+                    break;
+
+                case INFO_ARG:
+                    switch(b)
+                    {
+                        case '\r':
+                            m_drop = 1;
+                            break;
+                        case '\n':
+                            handler.process_info(argument(buf, i));
+
+                            m_arg_buf.resize(0);
+                            m_split_arg = false;
+                            m_drop = 0;
+                            m_as = i + 1;
+                            m_state = OP_START;
+                            break;
+                        default:
+                            if(m_split_arg)
+                                m_arg_buf.append(b);
+                            break;
+                    }
+                    break;
+            }
+        }
+
+        // control line is split, keep what we have so far
+        if((m_state == MSG_ARG || m_state == MINUS_ERR_ARG || m_state == INFO_ARG) && !m_split_arg)
+        {
+            m_arg_buf.resize(0);
+            m_arg_buf.append(buf + m_as, i - m_drop - m_as);
+            m_split_arg = true;
+        }
+
+        // payload is split, arguments still reference the buffer so they have to be copied
+        if(m_state == MSG_PAYLOAD && !m_split_msg)
+        {
+            if(!m_msg_arg_owned)
+            {
+                m_msg_arg.subject = QByteArray(m_msg_arg.subject.constData(), m_msg_arg.subject.size());
+                m_msg_arg.reply = QByteArray(m_msg_arg.reply.constData(), m_msg_arg.reply.size());
+                m_msg_arg_owned = true;
+            }
+
+            // size is only checked against max_payload, without it a bogus size must not allocate
+            m_msg_buf.reserve(m_max_payload > 0 ? m_msg_arg.size : qMin(m_msg_arg.size, m_max_reserve));
+            m_msg_buf.append(buf + m_as, length - m_as);
+            m_split_msg = true;
+        }
+
+        return true;
+    }
+
+    //!
+    //! \brief The Dispatcher class
+    //! delivers subscription messages on worker threads instead of the client thread,
+    //! messages of one subscription are always delivered in order and one at a time
+    //! callbacks run on worker threads so they must not use the client directly
+    //! dispatcher must outlive subscriptions using it
+    class Dispatcher
+    {
+    public:
+
+        //!
+        //! \brief Dispatcher
+        //! \param pool
+        //! without pool dispatcher delivers on its own dedicated thread, with pool
+        //! (e.g. QThreadPool::globalInstance()) subscriptions are spread over pool threads
+        explicit Dispatcher(QThreadPool *pool = nullptr) : m_pool(pool ? pool : &m_own_pool)
+        {
+            m_own_pool.setMaxThreadCount(1);
+            m_own_pool.setExpiryTimeout(-1);
+        }
+
+    private:
+        friend class Client;
+
+        //!
+        //! \brief The Strand struct
+        //! per subscription queue, at most one pool task drains it at any time
+        struct Strand
+        {
+            QThreadPool *pool = nullptr;
+            MessageHandler handler;
+
+            QMutex mutex;
+            QQueue<Message> queue;
+            bool running = false;
+
+            //! set when subscription is removed, remaining messages are discarded
+            std::atomic<bool> closed{false};
+
+            //! messages handed over but not yet delivered, counted against pending limits
+            std::atomic<qint64> pending_msgs{0};
+            std::atomic<qint64> pending_bytes{0};
+        };
+
+        QThreadPool m_own_pool;
+        QThreadPool *m_pool;
+
+        std::shared_ptr<Strand> create_strand(const MessageHandler &handler)
+        {
+            auto strand = std::make_shared<Strand>();
+            strand->pool = m_pool;
+            strand->handler = handler;
+
+            return strand;
+        }
+
+        // hand over detached messages, one lock per batch
+        static void post(const std::shared_ptr<Strand> &strand, QQueue<Message> &&messages, qint64 bytes)
+        {
+            strand->pending_msgs.fetch_add(messages.size(), std::memory_order_relaxed);
+            strand->pending_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+            QMutexLocker locker(&strand->mutex);
+
+            if(strand->queue.isEmpty())
+                strand->queue.swap(messages);
+            else
+                strand->queue.append(messages);
+
+            if(strand->running)
+                return;
+
+            strand->running = true;
+            strand->pool->start([strand] { run(strand); });
+        }
+
+        // deliver one batch and give the thread back to the pool so other strands get their turn
+        static void run(const std::shared_ptr<Strand> &strand)
+        {
+            QQueue<Message> batch;
+            {
+                QMutexLocker locker(&strand->mutex);
+                batch.swap(strand->queue);
+            }
+
+            for(const Message &message : std::as_const(batch))
+            {
+                if(!strand->closed.load(std::memory_order_relaxed))
+                    strand->handler(message);
+
+                strand->pending_msgs.fetch_sub(1, std::memory_order_relaxed);
+                strand->pending_bytes.fetch_sub(message.payload.size(), std::memory_order_relaxed);
+            }
+
+            QMutexLocker locker(&strand->mutex);
+
+            if(strand->queue.isEmpty())
+            {
+                strand->running = false;
+                return;
+            }
+
+            strand->pool->start([strand] { run(strand); });
+        }
+    };
+
+    class Client;
+
+#ifdef QT_NATS_COROUTINES
+    class ConnectAwaitable;
+    class RequestAwaitable;
+#endif
+
+    //!
+    //! \brief The Publisher class
+    //! publish handle for fixed subject and reply, obtained with Client::publisher()
+    //! frame prefix 'PUB <subject> [reply-to] ' is serialized and validated once, each publish
+    //! only writes length and payload, can be used from any thread like Client::publishBytes
+    class Publisher
+    {
+    public:
+        Publisher() = default;
+
+        //!
+        //! \brief isValid
+        //! \return false if subject or reply was not valid or client was destroyed
+        bool isValid() const;
+
+        //!
+        //! \brief publish
+        //! \param payload
+        //! \return false if message can not be buffered or publisher is not valid
+        bool publish(QByteArrayView payload) const;
+
+    private:
+        friend class Client;
+
+        Publisher(Client *client, const QByteArray &prefix);
+
+        //!
+        //! \brief m_client
+        QPointer<Client> m_client;
+
+        //!
+        //! \brief m_prefix
+        //! 'PUB <subject> [reply-to] '
+        QByteArray m_prefix;
+    };
+
+    //!
+    //! \brief The Client class
+    //! main client class
+    class Client : public QObject, private Parser::Handler
+    {
+        Q_OBJECT
+    public:
+        explicit Client(QObject *parent = nullptr);
+        ~Client();
+
+        //!
+        //! \brief publish
+        //! \param subject
+        //! \param message
+        //! publish given message with subject
+        void publish(const QString &subject, const QString &message, const QString &inbox);
+        void publish(const QString &subject, const QString &message = "");
+
+        //!
+        //! \brief publishBytes
+        //! \param subject
+        //! \param payload
+        //! \param reply
+        //! binary-safe publish, payload is written as is without any encoding
+        //! returns false if message can not be buffered while reconnecting
+        //! can be called from any thread, publishes from other threads go through a lock-free queue
+        //! drained by client thread and block while Options::max_queued_bytes is exceeded
+        bool publishBytes(QByteArrayView subject, QByteArrayView payload, QByteArrayView reply = {});
+
+        //!
+        //! \brief publishBytes
+        //! \param subject
+        //! \param headers
+        //! \param payload
+        //! \param reply
+        //! publish message with headers (HPUB), fails if server does not support headers
+        bool publishBytes(QByteArrayView subject, const Nats::Headers &headers, QByteArrayView payload, QByteArrayView reply = {});
+
+        //!
+        //! \brief subscribe
+        //! \param subject
+        //! \param callback
+        //! \return subscription id
+        //! subscribe to given subject
+        //! when message is received, callback is fired
+        uint64_t subscribe(const QString &subject, Nats::MessageCallback callback);
+
+        //!
+        //! \brief subscribe
+        //! \param subject
+        //! \param queue
+        //! \param callback
+        //! \return subscription id
+        //! overloaded function
+        //! subscribe to given subject and queue
+        //! when message is received, callback is fired
+        //! each message will be delivered to only one subscriber per queue group
+        uint64_t subscribe(const QString &subject, const QString &queue, Nats::MessageCallback callback);
+
+        //!
+        //! \brief subscribe
+        //! \param subject
+        //! \param handler
+        //! \return subscription id
+        //! binary-safe subscribe, handler receives payload without any decoding
+        uint64_t subscribe(const QString &subject, Nats::MessageHandler handler);
+        uint64_t subscribe(const QString &subject, const QString &queue, Nats::MessageHandler handler);
+
+        //!
+        //! \brief subscribe
+        //! \param subject
+        //! \param queue
+        //! \param handler
+        //! \param dispatcher
+        //! \return subscription id
+        //! messages are delivered on dispatcher threads, socket and parsing stay on client thread
+        uint64_t subscribe(const QString &subject, const QString &queue, Nats::MessageHandler handler, Nats::Dispatcher *dispatcher);
+
+        //!
+        //! \brief subscribe
+        //! \param subject
+        //! \return
+        //! return subscription class holding result for signal/slot version
+        Subscription *subscribe(const QString &subject);
+
+        //!
+        //! \brief unsubscribe
+        //! \param ssid
+        //! \param max_messages
+        //!
+        void unsubscribe(uint64_t ssid, int max_messages = 0);
+
+        //!
+        //! \brief setPendingLimits
+        //! \param ssid
+        //! \param max_messages
+        //! \param max_bytes
+        //! limit messages received but not yet delivered to subscription, -1 for no limit
+        void setPendingLimits(uint64_t ssid, int max_messages, qint64 max_bytes);
+
+        //!
+        //! \brief pendingMessages
+        //! \return number of messages waiting for delivery to subscription
+        int pendingMessages(uint64_t ssid) const;
+
+        //!
+        //! \brief droppedMessages
+        //! \return number of messages dropped because subscription was over its pending limits
+        uint64_t droppedMessages(uint64_t ssid) const;
+
+        //!
+        //! \brief request
+        //! \param subject
+        //! \param message
+        //! \return request id for cancelRequest, not a subscription id since requests share one inbox subscription
+        //! make request using given subject and optional message
+        //! all requests share one wildcard inbox subscription, first reply fires the callback
+        uint64_t request(const QString subject, const QString message, Nats::MessageCallback callback);
+        uint64_t request(const QString subject, Nats::MessageCallback callback);
+
+        //!
+        //! \brief request
+        //! \param subject
+        //! \param payload
+        //! \param handler
+        //! \param timeout
+        //! \param error
+        //! \return request id for cancelRequest, 0 if publish was rejected and error callback got 'publish failed'
+        //! binary-safe request, if no reply arrives within timeout (ms) error callback is fired
+        //! timeout of 0 waits for reply as long as the connection lives, pending requests fail with
+        //! 'connection lost' or 'connection closed'
+        uint64_t request(QByteArrayView subject, QByteArrayView payload, Nats::MessageHandler handler, int timeout = 0, Nats::ErrorCallback error = nullptr);
+
+        //!
+        //! \brief request
+        //! request with headers, error callback gets 'no responders' if nobody listens on subject
+        uint64_t request(QByteArrayView subject, const Nats::Headers &headers, QByteArrayView payload, Nats::MessageHandler handler, int timeout = 0, Nats::ErrorCallback error = nullptr);
+
+        //!
+        //! \brief cancelRequest
+        //! \param id request id returned by request or requestMany
+        //! forget pending request, none of its callbacks are called and late replies are ignored
+        void cancelRequest(uint64_t id);
+
+        //!
+        //! \brief requestMany
+        //! \param subject
+        //! \param payload
+        //! \param max_replies replies to collect, 0 for no limit
+        //! \param timeout overall deadline (ms), required since responder count is unknown
+        //! \param stall_timeout longest wait for next reply after the first one (ms), 0 to wait until deadline
+        //! \param handler called for each reply
+        //! \param finished called once collection ends, by count, deadline, stall or no responders
+        //! \return request id, 0 if timeout is not set or publish was rejected (finished is called right away)
+        //! scatter-gather request, replies of all responders arrive on the shared request inbox
+        uint64_t requestMany(QByteArrayView subject, QByteArrayView payload, int max_replies, int timeout, int stall_timeout,
+                             Nats::MessageHandler handler, Nats::FlushCallback finished = nullptr);
+
+        //!
+        //! \brief requestMany
+        //! collected replies are delivered at once when collection ends, empty list if nobody replied
+        uint64_t requestMany(QByteArrayView subject, QByteArrayView payload, int max_replies, int timeout, int stall_timeout,
+                             Nats::RepliesHandler handler);
+
+        //!
+        //! \brief publishBatch
+        //! \param messages
+        //! \return false if batch can not be buffered while reconnecting, nothing is published then
+        //! serialize all messages into buffer sized up front and write them at once
+        //! can be called from any thread, batch goes through the lock-free queue as one frame
+        bool publishBatch(const QList<Nats::BatchMessage> &messages);
+
+        //!
+        //! \brief publishBatch
+        //! \param subject
+        //! \param payloads
+        //! publish many payloads to one subject
+        bool publishBatch(QByteArrayView subject, const QList<QByteArray> &payloads);
+
+        //!
+        //! \brief publisher
+        //! \param subject
+        //! \param reply
+        //! \return publish handle with pre-serialized frame prefix, invalid if subject or reply is not valid
+        Nats::Publisher publisher(QByteArrayView subject, QByteArrayView reply = {});
+
+        //!
+        //! \brief newInbox
+        //! \return unique inbox subject '_INBOX.<nuid>'
+        QByteArray newInbox();
+
+        //!
+        //! \brief flush
+        //! \param callback
+        //! write all pending protocol frames to socket
+        //! if callback is given, PING is sent and callback fires when server replies with PONG,
+        //! at that point server has processed everything sent before
+        //! callback pending when connection is lost fires after reconnect, it is dropped when client gives up or is closed
+        void flush(Nats::FlushCallback callback = nullptr);
+
+        //!
+        //! \brief flushSync
+        //! \param timeout
+        //! \return true if server acknowledged all pending data within timeout (ms)
+        //! synchronous version of flush with PING/PONG round trip
+        bool flushSync(int timeout = 10000);
+
+        //!
+        //! \brief rtt
+        //! \return round trip time of the last PING/PONG in microseconds, -1 if not measured yet
+        //! measured by keepalive PINGs and flush with callback
+        qint64 rtt() const;
+
+        //!
+        //! \brief statistics
+        //! \return snapshot of counters, can be taken from any thread,
+        //! per-subscription statistics are only filled on client thread
+        Nats::Statistics statistics() const;
+
+#ifdef QT_NATS_COROUTINES
+        //!
+        //! \brief connectAsync
+        //! \return awaitable resuming with true once connected, false on connection error
+        //! co_await client.connectAsync("127.0.0.1", 4222);
+        Nats::ConnectAwaitable connectAsync(const QString &host = "127.0.0.1", quint16 port = 4222);
+        Nats::ConnectAwaitable connectAsync(const QString &host, quint16 port, const Nats::Options &options);
+
+        //!
+        //! \brief requestAsync
+        //! \return awaitable resuming with Reply, request is sent when awaited
+        //! timeout is required, 5 s by default, pending requests also fail when connection is lost
+        //! Nats::Reply reply = co_await client.requestAsync("service", payload, 1000);
+        Nats::RequestAwaitable requestAsync(QByteArrayView subject, QByteArrayView payload = {}, int timeout = 5000);
+        Nats::RequestAwaitable requestAsync(QByteArrayView subject, const Nats::Headers &headers, QByteArrayView payload, int timeout = 5000);
+#endif
+
+    signals:
+
+        //!
+        //! \brief connected
+        //! signal that the client is connected
+        void connected();
+
+        //!
+        //! \brief connected
+        //! signal that the client is connected
+        void error(const QString);
+
+        //!
+        //! \brief disconnected
+        //! signal that the client is disconnected
+        void disconnected();
+
+        //!
+        //! \brief reconnecting
+        //! signal that connection was lost and client started reconnecting
+        void reconnecting();
+
+        //!
+        //! \brief reconnected
+        //! signal that the client is connected again and subscriptions are restored
+        void reconnected();
+
+        //!
+        //! \brief slowConsumer
+        //! \param ssid
+        //! signal that subscription reached its pending limits and messages are being dropped,
+        //! emitted once until subscription catches up
+        void slowConsumer(uint64_t ssid);
+
+    public slots:
+
+        //!
+        //! \brief connect
+        //! \param host
+        //! \param port
+        //! connect to server with given host and port options
+        //! after valid connection is established 'connected' signal is emmited
+        void connect(const QString &host = "127.0.0.1", quint16 port = 4222, Nats::ConnectCallback callback = nullptr);
+        void connect(const QString &host, quint16 port, const Nats::Options &options, Nats::ConnectCallback callback = nullptr);
+
+        //!
+        //! \brief disconnect
+        //! disconnect from server by closing socket, client will not reconnect
+        void disconnect();
+
+        //!
+        //! \brief connectSync
+        //! \param host
+        //! \param port
+        //! synchronous version of connect, waits until connections with nats server is valid
+        //! this will still fire 'connected' signal if one wants to use that instead
+        bool connectSync(const QString &host = "127.0.0.1", quint16 port = 4222);
+        bool connectSync(const QString &host, quint16 port, const Nats::Options &options);
+
+    private:
+
+        //!
+        //! \brief CLRF
+        //! NATS protocol separator
+        const QByteArray CLRF = "\r\n";
+
+        //!
+        //! \brief m_parser
+        //! incremental parser for data received from server
+        Parser m_parser;
+
+        //!
+        //! \brief m_outbound
+        //! protocol frames waiting to be written to socket
+        QByteArray m_outbound;
+
+        //!
+        //! \brief m_flush_scheduled
+        //! flush of m_outbound is queued for next event loop iteration
+        bool m_flush_scheduled = false;
+
+        //!
+        //! \brief m_connected
+        //! CONNECT was sent and pending output can be written to socket, read by publishes from any thread
+        std::atomic<bool> m_connected{false};
+
+        //!
+        //! \brief The PendingPong struct
+        //! PING waiting for PONG
+        struct PendingPong
+        {
+            FlushCallback callback;
+            qint64 sent = 0;
+        };
+
+        //!
+        //! \brief m_queue
+        //! frames published from other threads
+        MpscQueue m_queue;
+        std::atomic<qint64> m_queued_bytes{0};
+
+        //! Options::max_queued_bytes taken at connect, options can be replaced while other threads publish
+        std::atomic<qint64> m_max_queued_bytes{32 * 1024 * 1024};
+        std::atomic<bool> m_drain_scheduled{false};
+
+        //!
+        //! \brief m_queue_mutex
+        //! publishing threads wait here for client thread to drain the queue
+        QMutex m_queue_mutex;
+        QWaitCondition m_queue_drained;
+        std::atomic<int> m_queue_waiters{0};
+
+        //!
+        //! \brief m_pongs
+        //! one entry for each PING sent, in order
+        QQueue<PendingPong> m_pongs;
+
+        //! flush callbacks whose PING was dropped with lost connection, PINGed again once reconnected
+        qsizetype m_pings_to_resend = 0;
+
+        //!
+        //! \brief m_ping_timer
+        //! sends keepalive PINGs and detects stale connections
+        QTimer m_ping_timer;
+        int m_pings_out = 0;
+
+        //!
+        //! \brief m_clock
+        //! monotonic clock for round trip measurement
+        QElapsedTimer m_clock;
+        qint64 m_rtt = -1;
+
+        //!
+        //! \brief m_ssid
+        //! subscribtion id holder
+        uint64_t m_ssid = 0;
+
+        //!
+        //! \brief m_socket
+        //! main tcp socket
+        QSslSocket m_socket;
+
+        //!
+        //! \brief m_options
+        //! client options
+        Options m_options;
+
+        //!
+        //! \brief The SubscriptionData struct
+        //! everything needed to deliver messages and to restore subscription after reconnect
+        struct SubscriptionData
+        {
+            QByteArray subject;
+            QByteArray queue;
+            MessageHandler handler;
+
+            //! subscription is removed after this many messages, 0 for no limit
+            uint64_t max = 0;
+
+            //! messages received from server
+            uint64_t delivered = 0;
+
+            //! messages waiting for callback, the last 'raw' of them still reference the read buffer
+            QQueue<Message> pending;
+            qint64 pending_bytes = 0;
+            qsizetype raw = 0;
+
+            int pending_msgs_limit = -1;
+            qint64 pending_bytes_limit = -1;
+            uint64_t dropped = 0;
+
+            //! over pending limits, slowConsumer signal was emitted
+            bool slow = false;
+
+            //! in m_ready queue
+            bool ready = false;
+
+            //! set when messages are delivered by a Dispatcher
+            std::shared_ptr<Dispatcher::Strand> strand;
+
+            //! signal based subscription, its queue counts as pending
+            QPointer<Subscription> notifier;
+        };
+
+        //!
+        //! \brief m_subscriptions
+        //! active subscriptions indexed by ssid - m_subscriptions_base, ssids only grow so the table stays dense
+        //! and removed slots are reclaimed from the front, callback keeps its subscription alive while it runs
+        QList<std::shared_ptr<SubscriptionData>> m_subscriptions;
+        uint64_t m_subscriptions_base = 1;
+        qsizetype m_subscriptions_live = 0;
+
+        //!
+        //! \brief m_old_subscriptions
+        //! long-lived subscriptions moved out of the table once it is mostly empty slots,
+        //! so they don't pin its front
+        QHash<uint64_t, std::shared_ptr<SubscriptionData>> m_old_subscriptions;
+
+        //!
+        //! \brief m_ready
+        //! subscriptions with pending messages, in delivery order
+        QQueue<uint64_t> m_ready;
+
+        //!
+        //! \brief m_dispatching
+        //! dispatch is running, callbacks waiting synchronously for data must not dispatch again
+        bool m_dispatching = false;
+        bool m_dispatch_scheduled = false;
+
+        //!
+        //! \brief m_delivering
+        //! subscription whose callbacks dispatch is running, 0 when none
+        uint64_t m_delivering = 0;
+
+        //!
+        //! \brief m_reading
+        //! socket read is being parsed or dispatched, set when callback reads again (flushSync)
+        bool m_reading = false;
+        bool m_parsing = false;
+
+        //!
+        //! \brief m_retired_buffers
+        //! read buffers replaced by nested read while messages of outer read still reference them
+        QList<QByteArray> m_retired_buffers;
+
+        //!
+        //! \brief The Server struct
+        //! server pool entry
+        struct Server
+        {
+            QString host;
+            quint16 port = 4222;
+            int reconnects = 0;
+            bool discovered = false;
+        };
+
+        //!
+        //! \brief m_servers
+        //! server pool, first is the one given to connect
+        QList<Server> m_servers;
+        int m_server_index = 0;
+
+        //!
+        //! \brief m_connect_callback
+        //! callback given to connect, fired only on initial connection
+        ConnectCallback m_connect_callback;
+
+        //!
+        //! \brief m_closing
+        //! connection is closed by user and should not be restored
+        bool m_closing = false;
+
+        //!
+        //! \brief m_reconnecting
+        //! connection was lost and client is trying to restore it
+        bool m_reconnecting = false;
+        int m_reconnect_attempt = 0;
+        QTimer m_reconnect_timer;
+
+        //!
+        //! \brief m_connect_timer
+        //! aborts connection attempt to unresponsive server so the pool is walked further
+        QTimer m_connect_timer;
+
+        //!
+        //! \brief The Counters struct
+        //! statistics counters, publish counters are updated from any thread
+        struct Counters
+        {
+            std::atomic<quint64> in_msgs{0};
+            std::atomic<quint64> in_bytes{0};
+            std::atomic<quint64> out_msgs{0};
+            std::atomic<quint64> out_bytes{0};
+            std::atomic<quint64> reconnects{0};
+            std::atomic<quint64> parse_errors{0};
+            std::atomic<qint64> max_buffered_bytes{0};
+        };
+
+        //!
+        //! \brief m_counters
+        Counters m_counters;
+
+        //!
+        //! \brief m_request_latency
+        //! with Options::latency_histograms
+        Histogram m_request_latency;
+        Histogram m_callback_latency;
+
+        //!
+        //! \brief The Response struct
+        //! callbacks of request waiting for reply
+        struct Response
+        {
+            MessageHandler handler;
+            ErrorCallback error;
+
+            //! send time (us) for latency histogram
+            qint64 sent = 0;
+
+            //! requestMany keeps entry until one of its limits is hit
+            bool many = false;
+            int max_replies = 0;
+            int replies = 0;
+            int stall = 0;
+            FlushCallback finished;
+        };
+
+        uint64_t start_request(QByteArrayView subject, const Headers &headers, QByteArrayView payload, Response response, int timeout);
+
+        void finish_request(uint64_t token);
+
+        //!
+        //! \brief fail_requests
+        //! replies of pending requests can not arrive anymore, requestMany ones finish with what they have
+        void fail_requests(const QString &error);
+
+        //!
+        //! \brief m_nuid
+        //! generator for inbox names
+        Nuid m_nuid;
+
+        //!
+        //! \brief m_read_buffer
+        //! socket is read into it, parsed messages reference it until dispatched
+        QByteArray m_read_buffer;
+
+        //!
+        //! \brief m_max_payload
+        //! max_payload from server INFO, 0 until known, read by publishes from any thread
+        std::atomic<qint64> m_max_payload{0};
+
+        //!
+        //! \brief exceeds_max_payload
+        //! \return true and warns if message is over max_payload
+        bool exceeds_max_payload(qsizetype size) const;
+
+        //!
+        //! \brief m_headers_supported
+        //! server announced headers support in INFO, read by publishes from any thread
+        std::atomic<bool> m_headers_supported{false};
+
+        //!
+        //! \brief m_resp_prefix
+        //! prefix of request inboxes, '_INBOX.<id>.', request token is appended to it
+        QByteArray m_resp_prefix;
+
+        //!
+        //! \brief m_resp_ssid
+        //! id of wildcard subscription receiving all replies, 0 until first request
+        uint64_t m_resp_ssid = 0;
+
+        //!
+        //! \brief m_resp_token
+        //! last request token
+        uint64_t m_resp_token = 0;
+
+        //!
+        //! \brief m_responses
+        //! requests waiting for reply by token
+        QHash<uint64_t, Response> m_responses;
+
+        //!
+        //! \brief process_response
+        //! \param message
+        //! dispatch reply received on wildcard inbox to its request
+        void process_response(const Message &message);
+
+        //!
+        //! \brief send_info
+        //! \param options
+        //! send client information and options to server
+        void send_info(const Options &options);
+
+        //!
+        //! \brief parse_info
+        //! \param message
+        //! \return
+        //! parse INFO message from server and return json object with data
+        QJsonObject parse_info(const QByteArray &message);
+
+        //!
+        //! \brief set_listeners
+        //! set connection listeners
+        void set_listeners();
+
+        //!
+        //! \brief set_servers
+        //! build server pool from given server and options
+        void set_servers(const QString &host, quint16 port, const Options &options);
+
+        //!
+        //! \brief add_servers
+        //! \param info
+        //! add servers advertised by cluster to the pool
+        void add_servers(const QJsonObject &info);
+
+        //!
+        //! \brief parse_server
+        //! \return false if url is not valid
+        //! parse 'host:port' or 'nats://host:port'
+        static bool parse_server(const QString &url, Server &server);
+
+        //!
+        //! \brief connect_to_server
+        //! start connection to current server from the pool
+        void connect_to_server();
+
+        //!
+        //! \brief start_encryption
+        //! \param info
+        //! \return true if TLS handshake was started
+        //! start TLS if client or server requires it
+        bool start_encryption(const QJsonObject &info);
+
+        //!
+        //! \brief handshake_finished
+        //! send CONNECT and notify about (re)established connection
+        void handshake_finished();
+
+        //!
+        //! \brief handle_disconnect
+        //! socket is closed, start reconnecting if needed
+        void handle_disconnect();
+
+        //!
+        //! \brief schedule_reconnect
+        //! pick next server from the pool and schedule connection attempt with backoff
+        void schedule_reconnect();
+
+        //!
+        //! \brief write_subscriptions
+        //! send all active subscriptions, used after CONNECT
+        void write_subscriptions();
+
+        //!
+        //! \brief drop_protocol_frames
+        //! keep only publishes in output when connection is lost, SUB/UNSUB/PING frames still waiting
+        //! there are stale once write_subscriptions restores the subscription table
+        void drop_protocol_frames();
+
+        //!
+        //! \brief find_subscription
+        //! \return subscription with given ssid or null, reference is only valid until table changes
+        const std::shared_ptr<SubscriptionData> &find_subscription(uint64_t ssid) const;
+
+        //!
+        //! \brief remove_subscription
+        //! remove subscription from table, callback still running keeps its copy
+        void remove_subscription(uint64_t ssid);
+
+        //!
+        //! \brief for_each_subscription
+        //! call function(ssid, subscription) for all active subscriptions
+        template<typename Function>
+        void for_each_subscription(Function function) const
+        {
+            for(auto it = m_old_subscriptions.cbegin(); it != m_old_subscriptions.cend(); ++it)
+                function(it.key(), *it.value());
+
+            for(qsizetype i = 0; i < m_subscriptions.size(); ++i)
+            {
+                if(m_subscriptions[i])
+                    function(m_subscriptions_base + uint64_t(i), *m_subscriptions[i]);
+            }
+        }
+
+        //!
+        //! \brief dispatch
+        //! deliver pending messages to callbacks, within dispatch slice
+        //! messages left for later are detached from the read buffer
+        void dispatch();
+
+        //!
+        //! \brief detach_pending
+        //! copy pending messages of subscription still referencing the read buffer
+        void detach_pending(uint64_t ssid);
+
+        //!
+        //! \brief schedule_flush
+        //! flush pending output on next event loop iteration or now if threshold is crossed
+        void schedule_flush();
+
+        //!
+        //! \brief enqueue_frame
+        //! publish from other thread, hand frame over to client thread
+        void enqueue_frame(QByteArray &&frame);
+
+        //!
+        //! \brief publish_batch
+        //! hand serialized batch of given size over to output
+        bool publish_batch(qsizetype size, qsizetype count, qsizetype payload_bytes, const std::function<void(QByteArray &)> &serialize);
+
+        //!
+        //! \brief publish_prefixed
+        //! write PUB frame with serialized prefix, used by Publisher
+        bool publish_prefixed(const QByteArray &prefix, QByteArrayView payload);
+
+        friend class Publisher;
+
+#ifdef QT_NATS_COROUTINES
+        friend class ConnectAwaitable;
+#endif
+
+        //!
+        //! \brief drain_queue
+        //! move frames published from other threads to pending output
+        void drain_queue();
+
+        //!
+        //! \brief send_ping
+        //! \param callback
+        //! queue PING, callback (if any) fires on matching PONG
+        void send_ping(FlushCallback callback);
+
+        //!
+        //! \brief process_ping_timer
+        //! send keepalive PING or close connection if too many are unanswered
+        void process_ping_timer();
+
+        // Parser::Handler, called for each parsed operation
+        void process_msg(const MsgArg &args, const QByteArray &headers, const QByteArray &payload) override;
+
+        //!
+        //! \brief report_slow_consumer
+        //! count dropped message, warn and emit slowConsumer() once until messages flow again
+        void report_slow_consumer(SubscriptionData &subscription, uint64_t ssid);
+        void process_ping() override;
+        void process_pong() override;
+        void process_ok() override;
+        void process_err(QByteArrayView message) override;
+        void process_info(QByteArrayView message) override;
+    };
+
+    // timers and socket are children so moveToThread takes them along
+    inline Client::Client(QObject *parent) : QObject(parent),
+        m_ping_timer(this),
+        m_socket(this),
+        m_reconnect_timer(this),
+        m_connect_timer(this)
+    {
+        enable_debug_from_environment();
+
+        m_reconnect_timer.setSingleShot(true);
+        QObject::connect(&m_reconnect_timer, &QTimer::timeout, this, [this]
+        {
+            connect_to_server();
+        });
+
+        m_connect_timer.setSingleShot(true);
+        QObject::connect(&m_connect_timer, &QTimer::timeout, this, [this]
+        {
+            DEBUG_CONNECTION("connect timeout");
+
+            emit error(QStringLiteral("connect timeout"));
+
+            // reported as disconnect, next server is tried
+            m_socket.abort();
+        });
+
+        QObject::connect(&m_ping_timer, &QTimer::timeout, this, [this]
+        {
+            process_ping_timer();
+        });
+
+        m_clock.start();
+    }
+
+    inline Client::~Client()
+    {
+        // socket is destroyed after members declared below it, its abort must not reach handle_disconnect
+        m_closing = true;
+        QObject::disconnect(&m_socket, nullptr, this, nullptr);
+    }
+
+    inline void Client::connect(const QString &host, quint16 port, ConnectCallback callback)
+    {
+        connect(host, port, m_options, callback);
+    }
+
+    inline void Client::connect(const QString &host, quint16 port, const Options &options, ConnectCallback callback)
+    {
+        // Check is client socket is already connected and return if it is
+        if (m_socket.isOpen() || m_reconnecting)
+            return;
+
+        m_options = options;
+        m_max_queued_bytes = options.max_queued_bytes;
+        m_connect_callback = callback;
+        m_closing = false;
+
+        set_servers(host, port, options);
+        connect_to_server();
+    }
+
+    inline void Client::connect_to_server()
+    {
+        const Server &server = m_servers.at(m_server_index);
+
+        QObject::connect(&m_socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError socketError)
+        {
+            DEBUG_CONNECTION(socketError);
+
+            emit error(m_socket.errorString());
+        });
+
+        QObject::connect(&m_socket, static_cast<void(QSslSocket::*)(const QList<QSslError> &)>(&QSslSocket::sslErrors),this, [this](const QList<QSslError> &errors)
+        {
+            DEBUG_CONNECTION(errors);
+
+            emit error(m_socket.errorString());
+        });
+
+        QObject::connect(&m_socket, &QSslSocket::encrypted, this, [this]
+        {
+            DEBUG_CONNECTION("SSL/TLS successful");
+
+            handshake_finished();
+        });
+
+        // covers both lost connections and failed connection attempts
+        QObject::connect(&m_socket, &QAbstractSocket::stateChanged, this, [this](QAbstractSocket::SocketState state)
+        {
+            if(state == QAbstractSocket::UnconnectedState)
+                handle_disconnect();
+        });
+
+        // receive first info message and disconnect
+        auto signal = std::make_shared<QMetaObject::Connection>();
+        *signal = QObject::connect(&m_socket, &QSslSocket::readyRead, this, [this, signal]
+        {
+            QObject::disconnect(*signal);
+            QByteArray info_message = m_socket.readAll();
+
+            QJsonObject json = parse_info(info_message);
+            add_servers(json);
+
+            if(!start_encryption(json))
+                handshake_finished();
+        });
+
+        DEBUG_CONNECTION("connect started" << server.host << server.port);
+
+        if(m_options.connect_timeout > 0)
+            m_connect_timer.start(m_options.connect_timeout);
+
+        m_socket.connectToHost(server.host, server.port);
+    }
+
+    inline bool Client::start_encryption(const QJsonObject &info)
+    {
+        bool ssl_required = info.value(QStringLiteral("ssl_required")).toBool();
+
+        // if client or server wants ssl start encryption
+        if(!m_options.ssl && !m_options.ssl_required && !ssl_required)
+            return false;
+
+        DEBUG_CONNECTION("starting SSL/TLS encryption");
+
+        if(!m_options.ssl_verify)
+            m_socket.setPeerVerifyMode(QSslSocket::VerifyNone);
+
+        if(!m_options.ssl_ca.isEmpty())
+        {
+            QSslConfiguration config = m_socket.sslConfiguration();
+            config.setCaCertificates(QSslCertificate::fromPath(m_options.ssl_ca));
+            m_socket.setSslConfiguration(config);
+        }
+
+        if(!m_options.ssl_key.isEmpty())
+            m_socket.setPrivateKey(m_options.ssl_key);
+
+        if(!m_options.ssl_cert.isEmpty())
+            m_socket.setLocalCertificate(m_options.ssl_cert);
+
+        m_socket.startClientEncryption();
+
+        return true;
+    }
+
+    inline void Client::handshake_finished()
+    {
+        m_connect_timer.stop();
+
+        send_info(m_options);
+        set_listeners();
+
+        m_servers[m_server_index].reconnects = 0;
+
+        if(m_reconnecting)
+        {
+            DEBUG_CONNECTION("reconnected");
+
+            m_reconnecting = false;
+            m_reconnect_attempt = 0;
+
+            m_counters.reconnects.fetch_add(1, std::memory_order_relaxed);
+
+            emit reconnected();
+            return;
+        }
+
+        if(m_connect_callback)
+            m_connect_callback();
+
+        emit connected();
+    }
+
+    inline void Client::handle_disconnect()
+    {
+        DEBUG_CONNECTION("socket disconnected");
+
+        const bool was_connected = m_connected;
+
+        m_connected = false;
+        m_pings_out = 0;
+        m_ping_timer.stop();
+        m_connect_timer.stop();
+
+        // Disconnect everything connected to an m_socket's signals
+        QObject::disconnect(&m_socket, nullptr, nullptr, nullptr);
+
+        // queued PINGs go with the rest of protocol frames, failed reconnect attempts included,
+        // keepalives are forgotten and flush callbacks wait for PINGs on the next connection
+        drop_protocol_frames();
+        m_pongs.removeIf([](const PendingPong &pong) { return !pong.callback; });
+        m_pings_to_resend = m_pongs.size();
+
+        if(was_connected)
+        {
+            emit disconnected();
+
+            // replies sent while connection is down are lost
+            if(!m_closing)
+                fail_requests(QStringLiteral("connection lost"));
+        }
+
+        // initial connection failures are reported through error signal only
+        if(m_closing || !m_options.allow_reconnect || (!was_connected && !m_reconnecting))
+        {
+            m_reconnecting = false;
+            m_pongs.clear();
+            m_pings_to_resend = 0;
+            return;
+        }
+
+        if(!m_reconnecting)
+        {
+            m_reconnecting = true;
+            m_reconnect_attempt = 0;
+
+            emit reconnecting();
+        }
+
+        schedule_reconnect();
+    }
+
+    inline void Client::schedule_reconnect()
+    {
+        const int max_attempts = m_options.max_reconnect_attempts;
+
+        // next server in the pool which still has attempts left
+        int next = -1;
+        for(int i = 1; i <= m_servers.size(); ++i)
+        {
+            const int index = (m_server_index + i) % m_servers.size();
+            if(max_attempts < 0 || m_servers.at(index).reconnects < max_attempts)
+            {
+                next = index;
+                break;
+            }
+        }
+
+        if(next == -1)
+        {
+            qCritical() << "maximum reconnect attempts reached";
+
+            m_reconnecting = false;
+            m_outbound.clear();
+            m_pongs.clear();
+            m_pings_to_resend = 0;
+
+            emit error(QStringLiteral("maximum reconnect attempts reached"));
+            return;
+        }
+
+        m_server_index = next;
+        m_servers[next].reconnects++;
+
+        // jittered exponential backoff, first attempt is immediate so failover is fast
+        int delay = 0;
+        if(m_reconnect_attempt > 0)
+        {
+            const int exponent = qMin(m_reconnect_attempt - 1, 16);
+            delay = int(qMin<qint64>(qint64(m_options.reconnect_wait) << exponent, m_options.max_reconnect_wait));
+        }
+
+        if(m_options.reconnect_jitter > 0)
+            delay += QRandomGenerator::global()->bounded(m_options.reconnect_jitter);
+
+        m_reconnect_attempt++;
+
+        DEBUG_CONNECTION("reconnecting to" << m_servers.at(next).host << m_servers.at(next).port << "in" << delay << "ms");
+
+        m_reconnect_timer.start(delay);
+    }
+
+    inline void Client::set_servers(const QString &host, quint16 port, const Options &options)
+    {
+        m_servers.clear();
+        m_server_index = 0;
+
+        Server server;
+        server.host = host;
+        server.port = port;
+        m_servers.append(server);
+
+        for(const QString &url : options.servers)
+        {
+            if(parse_server(url, server))
+                m_servers.append(server);
+            else
+                qWarning() << "invalid server url" << url;
+        }
+    }
+
+    inline void Client::add_servers(const QJsonObject &info)
+    {
+        if(m_options.ignore_discovered_servers)
+            return;
+
+        const QJsonArray urls = info.value(QStringLiteral("connect_urls")).toArray();
+        for(const QJsonValue &url : urls)
+        {
+            Server server;
+            if(!parse_server(url.toString(), server))
+                continue;
+
+            bool known = false;
+            for(const Server &existing : std::as_const(m_servers))
+            {
+                if(existing.host == server.host && existing.port == server.port)
+                {
+                    known = true;
+                    break;
+                }
+            }
+
+            if(known)
+                continue;
+
+            DEBUG_CONNECTION("discovered server" << server.host << server.port);
+
+            server.discovered = true;
+            m_servers.append(server);
+        }
+    }
+
+    inline bool Client::parse_server(const QString &url, Server &server)
+    {
+        const QUrl parsed(url.contains(QStringLiteral("://")) ? url : QStringLiteral("nats://") + url);
+        if(!parsed.isValid() || parsed.host().isEmpty())
+            return false;
+
+        server = Server();
+        server.host = parsed.host();
+        server.port = quint16(parsed.port(4222));
+
+        return true;
+    }
+
+    inline void Client::disconnect()
+    {
+        m_closing = true;
+        m_reconnecting = false;
+        m_reconnect_timer.stop();
+        m_connect_timer.stop();
+
+        fail_requests(QStringLiteral("connection closed"));
+
+        flush();
+
+        // nothing buffered while disconnected survives explicit close
+        m_outbound.clear();
+
+        m_socket.flush();
+        m_socket.close();
+    }
+
+    inline bool Client::connectSync(const QString &host, quint16 port)
+    {
+        return connectSync(host, port, m_options);
+    }
+
+    inline bool Client::connectSync(const QString &host, quint16 port, const Options &options)
+    {
+        m_options = options;
+        m_max_queued_bytes = options.max_queued_bytes;
+        m_connect_callback = nullptr;
+        m_closing = false;
+
+        set_servers(host, port, options);
+
+         QObject::connect(&m_socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError socketError)
+
+        {
+            DEBUG_CONNECTION(socketError);
+
+            emit error(m_socket.errorString());
+        });
+
+        QObject::connect(&m_socket, &QAbstractSocket::stateChanged, this, [this](QAbstractSocket::SocketState state)
+        {
+            if(state == QAbstractSocket::UnconnectedState)
+                handle_disconnect();
+        });
+
+        m_socket.connectToHost(host, port);
+        if(!m_socket.waitForConnected())
+            return false;
+
+        if(!m_socket.waitForReadyRead())
+            return false;
+
+        // receive first info message
+        auto info_message = m_socket.readAll();
+
+        QJsonObject json = parse_info(info_message);
+        add_servers(json);
+
+        if(start_encryption(json) && !m_socket.waitForEncrypted())
+            return false;
+
+        send_info(options);
+        set_listeners();
+
+        emit connected();
+
+        return true;
+    }
+
+    inline void Client::drop_protocol_frames()
+    {
+        QByteArray publishes;
+        qsizetype position = 0;
+
+        while(position < m_outbound.size())
+        {
+            const qsizetype end_of_line = m_outbound.indexOf("\r\n", position);
+            if(end_of_line < 0)
+                break;
+
+            const QByteArrayView line(m_outbound.constData() + position, end_of_line - position);
+            qsizetype next = end_of_line + 2;
+
+            // PUB <subject> [reply-to] <#bytes>, HPUB <subject> [reply-to] <#header bytes> <#total bytes>
+            if(line.startsWith("PUB ") || line.startsWith("HPUB "))
+            {
+                const int64_t size = Parser::parse_uint(line.sliced(line.lastIndexOf(' ') + 1));
+                if(size < 0)
+                    break;
+
+                next += size + 2;
+                publishes.append(m_outbound.constData() + position, qMin(next, m_outbound.size()) - position);
+            }
+
+            position = next;
+        }
+
+        DEBUG_PROTOCOL("dropped protocol frames:" << m_outbound.size() - publishes.size());
+
+        m_outbound = publishes;
+    }
+
+    inline void Client::send_info(const Options &options)
+    {
+        // headers also enable no responders status replies for requests
+        QString message =
+                QString("CONNECT {")
+                % "\"verbose\":" % (options.verbose ? "true" : "false") % ","
+                % "\"pedantic\":" % (options.pedantic ? "true" : "false") % ","
+                % "\"ssl_required\":" % (options.ssl_required ? "true" : "false") % ","
+                % "\"name\":" % "\"" % options.name % "\","
+                % "\"lang\":" % "\"" %options.lang % "\","
+                % "\"user\":" % "\"" % options.user % "\","
+                % "\"pass\":" % "\"" % options.pass % "\","
+                % "\"auth_token\":" % "\"" % options.token % "\","
+                % "\"headers\":true,"
+                % "\"no_responders\":true"
+                % "} " % CLRF;
+
+        DEBUG_CONNECTION("send info message:" << message);
+
+        // CONNECT has to go before anything buffered while connecting,
+        // subscriptions go before buffered publishes so no message is missed
+        m_socket.write(message.toUtf8());
+        write_subscriptions();
+
+        // after buffered publishes, flush callbacks complete once those reached the server
+        for(; m_pings_to_resend > 0; --m_pings_to_resend)
+            m_outbound.append("PING\r\n", 6);
+
+        m_connected = true;
+        flush();
+    }
+
+    // SUB <subject> [queue group] <sid>, followed by UNSUB <sid> <remaining> for limited subscriptions
+    inline void Client::write_subscriptions()
+    {
+        QByteArray frames;
+
+        for_each_subscription([&frames](uint64_t ssid, const SubscriptionData &subscription)
+        {
+            frames.append("SUB ", 4);
+            frames.append(subscription.subject);
+            frames.append(' ');
+
+            if(!subscription.queue.isEmpty())
+            {
+                frames.append(subscription.queue);
+                frames.append(' ');
+            }
+
+            append_number(frames, ssid);
+            frames.append("\r\n", 2);
+
+            if(subscription.max > 0)
+            {
+                frames.append("UNSUB ", 6);
+                append_number(frames, ssid);
+                frames.append(' ');
+                append_number(frames, subscription.max - subscription.delivered);
+                frames.append("\r\n", 2);
+            }
+        });
+
+        DEBUG_PROTOCOL("subscriptions:" << frames);
+
+        if(!frames.isEmpty())
+            m_socket.write(frames);
+    }
+
+    inline QJsonObject Client::parse_info(const QByteArray &message)
+    {
+        DEBUG_PROTOCOL(message);
+
+        // discard 'INFO '
+        QJsonObject json = QJsonDocument::fromJson(message.mid(5)).object();
+        m_headers_supported = json.value(QStringLiteral("headers")).toBool();
+
+        m_max_payload = json.value(QStringLiteral("max_payload")).toInteger(0);
+        m_parser.setMaxPayload(qsizetype(m_max_payload.load()));
+
+        return json;
+    }
+
+    inline void Client::publish(const QString &subject, const QString &message)
+    {
+        publish(subject, message, "");
+    }
+
+    inline void Client::publish(const QString &subject, const QString &message, const QString &inbox)
+    {
+        publishBytes(subject.toUtf8(), message.toUtf8(), inbox.toUtf8());
+    }
+
+    inline bool Client::exceeds_max_payload(qsizetype size) const
+    {
+        const qint64 max_payload = m_max_payload.load(std::memory_order_relaxed);
+        if(max_payload <= 0 || size <= max_payload)
+            return false;
+
+        qWarning() << "maximum payload exceeded, message dropped:" << size << ">" << max_payload;
+        return true;
+    }
+
+    // PUB <subject> [reply-to] <#bytes>\r\n[payload]\r\n
+    inline bool Client::publishBytes(QByteArrayView subject, QByteArrayView payload, QByteArrayView reply)
+    {
+        // server would close connection
+        if(exceeds_max_payload(payload.size()))
+            return false;
+
+        DEBUG_PROTOCOL("published:" << subject << reply << payload);
+
+        // socket can only be used from client thread
+        if(QThread::currentThread() != thread())
+        {
+            QByteArray frame;
+            frame.reserve(subject.size() + reply.size() + payload.size() + 32);
+            append_pub(frame, subject, payload, reply);
+
+            enqueue_frame(std::move(frame));
+
+            m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+            m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+            return true;
+        }
+
+        // bounded buffer while connection is being restored
+        if(!m_connected && m_options.reconnect_buffer_size >= 0
+                && m_outbound.size() + subject.size() + reply.size() + payload.size() + 32 > m_options.reconnect_buffer_size)
+        {
+            qWarning() << "reconnect buffer full, message dropped";
+            return false;
+        }
+
+        append_pub(m_outbound, subject, payload, reply);
+
+        m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+        m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+
+        schedule_flush();
+
+        return true;
+    }
+
+    // HPUB <subject> [reply-to] <#header bytes> <#total bytes>\r\n[headers][payload]\r\n
+    inline bool Client::publishBytes(QByteArrayView subject, const Headers &headers, QByteArrayView payload, QByteArrayView reply)
+    {
+        if(headers.isEmpty())
+            return publishBytes(subject, payload, reply);
+
+        // INFO is only known once connected, buffered messages are checked by server
+        if(m_connected && !m_headers_supported)
+        {
+            qWarning() << "server does not support headers, message dropped";
+            return false;
+        }
+
+        const QByteArray block = headers.toByteArray();
+
+        if(exceeds_max_payload(block.size() + payload.size()))
+            return false;
+
+        DEBUG_PROTOCOL("published:" << subject << reply << block << payload);
+
+        if(QThread::currentThread() != thread())
+        {
+            QByteArray frame;
+            frame.reserve(subject.size() + reply.size() + block.size() + payload.size() + 48);
+            append_hpub(frame, subject, block, payload, reply);
+
+            enqueue_frame(std::move(frame));
+
+            m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+            m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+            return true;
+        }
+
+        if(!m_connected && m_options.reconnect_buffer_size >= 0
+                && m_outbound.size() + subject.size() + reply.size() + block.size() + payload.size() + 48 > m_options.reconnect_buffer_size)
+        {
+            qWarning() << "reconnect buffer full, message dropped";
+            return false;
+        }
+
+        append_hpub(m_outbound, subject, block, payload, reply);
+
+        m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+        m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+
+        schedule_flush();
+
+        return true;
+    }
+
+    // PUB <subject> [reply-to] <#bytes>\r\n[payload]\r\n for each message, one buffer and one write
+    inline bool Client::publishBatch(const QList<BatchMessage> &messages)
+    {
+        qsizetype size = 0;
+        qsizetype payload_bytes = 0;
+
+        for(const BatchMessage &message : messages)
+        {
+            if(exceeds_max_payload(message.payload.size()))
+                return false;
+
+            size += 4 + message.subject.size() + 1 + (message.reply.isEmpty() ? 0 : message.reply.size() + 1)
+                    + number_length(uint64_t(message.payload.size())) + 2 + message.payload.size() + 2;
+            payload_bytes += message.payload.size();
+        }
+
+        return publish_batch(size, messages.size(), payload_bytes, [&messages](QByteArray &buffer)
+        {
+            for(const BatchMessage &message : messages)
+                append_pub(buffer, message.subject, message.payload, message.reply);
+        });
+    }
+
+    inline bool Client::publishBatch(QByteArrayView subject, const QList<QByteArray> &payloads)
+    {
+        qsizetype size = 0;
+        qsizetype payload_bytes = 0;
+
+        for(const QByteArray &payload : payloads)
+        {
+            if(exceeds_max_payload(payload.size()))
+                return false;
+
+            size += 4 + subject.size() + 1 + number_length(uint64_t(payload.size())) + 2 + payload.size() + 2;
+            payload_bytes += payload.size();
+        }
+
+        return publish_batch(size, payloads.size(), payload_bytes, [subject, &payloads](QByteArray &buffer)
+        {
+            for(const QByteArray &payload : payloads)
+                append_pub(buffer, subject, payload, {});
+        });
+    }
+
+    inline bool Client::publish_batch(qsizetype size, qsizetype count, qsizetype payload_bytes, const std::function<void(QByteArray &)> &serialize)
+    {
+        if(count == 0)
+            return true;
+
+        if(QThread::currentThread() != thread())
+        {
+            QByteArray frame;
+            frame.reserve(size);
+            serialize(frame);
+
+            enqueue_frame(std::move(frame));
+        }
+        else
+        {
+            if(!m_connected && m_options.reconnect_buffer_size >= 0 && m_outbound.size() + size > m_options.reconnect_buffer_size)
+            {
+                qWarning() << "reconnect buffer full, batch dropped";
+                return false;
+            }
+
+            // everything buffered before goes out in the same write
+            m_outbound.reserve(m_outbound.size() + size);
+            serialize(m_outbound);
+
+            flush();
+        }
+
+        m_counters.out_msgs.fetch_add(quint64(count), std::memory_order_relaxed);
+        m_counters.out_bytes.fetch_add(quint64(payload_bytes), std::memory_order_relaxed);
+
+        return true;
+    }
+
+    inline Publisher Client::publisher(QByteArrayView subject, QByteArrayView reply)
+    {
+        if(!is_valid_subject(subject) || (!reply.isEmpty() && !is_valid_subject(reply)))
+        {
+            qWarning() << "invalid publish subject:" << subject << reply;
+            return Publisher();
+        }
+
+        QByteArray prefix;
+        prefix.reserve(subject.size() + reply.size() + 6);
+        prefix.append("PUB ", 4);
+        prefix.append(subject.data(), subject.size());
+        prefix.append(' ');
+
+        if(!reply.isEmpty())
+        {
+            prefix.append(reply.data(), reply.size());
+            prefix.append(' ');
+        }
+
+        return Publisher(this, prefix);
+    }
+
+    // <prefix><#bytes>\r\n[payload]\r\n
+    inline bool Client::publish_prefixed(const QByteArray &prefix, QByteArrayView payload)
+    {
+        if(exceeds_max_payload(payload.size()))
+            return false;
+
+        if(QThread::currentThread() != thread())
+        {
+            QByteArray frame;
+            frame.reserve(prefix.size() + payload.size() + 24);
+            frame.append(prefix);
+            append_number(frame, uint64_t(payload.size()));
+            frame.append("\r\n", 2);
+            frame.append(payload.data(), payload.size());
+            frame.append("\r\n", 2);
+
+            enqueue_frame(std::move(frame));
+
+            m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+            m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+            return true;
+        }
+
+        if(!m_connected && m_options.reconnect_buffer_size >= 0
+                && m_outbound.size() + prefix.size() + payload.size() + 24 > m_options.reconnect_buffer_size)
+        {
+            qWarning() << "reconnect buffer full, message dropped";
+            return false;
+        }
+
+        m_outbound.append(prefix);
+        append_number(m_outbound, uint64_t(payload.size()));
+        m_outbound.append("\r\n", 2);
+        m_outbound.append(payload.data(), payload.size());
+        m_outbound.append("\r\n", 2);
+
+        m_counters.out_msgs.fetch_add(1, std::memory_order_relaxed);
+        m_counters.out_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+
+        schedule_flush();
+
+        return true;
+    }
+
+    inline Publisher::Publisher(Client *client, const QByteArray &prefix) :
+        m_client(client),
+        m_prefix(prefix)
+    {
+    }
+
+    inline bool Publisher::isValid() const
+    {
+        return m_client && !m_prefix.isEmpty();
+    }
+
+    inline bool Publisher::publish(QByteArrayView payload) const
+    {
+        Client *client = m_client.data();
+        if(!client || m_prefix.isEmpty())
+            return false;
+
+        return client->publish_prefixed(m_prefix, payload);
+    }
+
+    inline void Client::enqueue_frame(QByteArray &&frame)
+    {
+        const qint64 size = frame.size();
+
+        // back-pressure, wait for client thread to catch up
+        const qint64 max_queued_bytes = m_max_queued_bytes.load(std::memory_order_relaxed);
+
+        if(m_queued_bytes.load() + size > max_queued_bytes && m_queued_bytes.load() > 0)
+        {
+            QMutexLocker locker(&m_queue_mutex);
+            m_queue_waiters++;
+
+            while(m_queued_bytes.load() + size > max_queued_bytes && m_queued_bytes.load() > 0)
+                m_queue_drained.wait(&m_queue_mutex, 100);
+
+            m_queue_waiters--;
+        }
+
+        auto node = new MpscQueue::Node;
+        node->data = std::move(frame);
+
+        m_queued_bytes += size;
+        m_queue.push(node);
+
+        // one queued call per batch instead of one per message
+        if(!m_drain_scheduled.exchange(true))
+        {
+            QMetaObject::invokeMethod(this, [this]
+            {
+                drain_queue();
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    inline void Client::drain_queue()
+    {
+        // reset first, producers pushing from now on schedule another drain
+        m_drain_scheduled = false;
+
+        qint64 drained = 0;
+        while(MpscQueue::Node *node = m_queue.pop())
+        {
+            drained += node->data.size();
+
+            if(m_connected || m_options.reconnect_buffer_size < 0
+                    || m_outbound.size() + node->data.size() <= m_options.reconnect_buffer_size)
+                m_outbound.append(node->data);
+            else
+                qWarning() << "reconnect buffer full, message dropped";
+
+            delete node;
+        }
+
+        if(drained == 0)
+            return;
+
+        m_queued_bytes -= drained;
+
+        if(m_queue_waiters.load() > 0)
+        {
+            QMutexLocker locker(&m_queue_mutex);
+            m_queue_drained.wakeAll();
+        }
+
+        schedule_flush();
+    }
+
+    inline uint64_t Client::subscribe(const QString &subject, MessageCallback callback)
+    {
+        return subscribe(subject, "", callback);
+    }
+
+    inline uint64_t Client::subscribe(const QString &subject, const QString &queue, MessageCallback callback)
+    {
+        // legacy callbacks receive decoded strings
+        return subscribe(subject, queue, [callback](const Message &message)
+        {
+            callback(QString::fromUtf8(message.payload), QString::fromUtf8(message.reply), QString::fromUtf8(message.subject));
+        });
+    }
+
+    inline uint64_t Client::subscribe(const QString &subject, MessageHandler handler)
+    {
+        return subscribe(subject, "", handler);
+    }
+
+    inline uint64_t Client::subscribe(const QString &subject, const QString &queue, MessageHandler handler, Dispatcher *dispatcher)
+    {
+        const uint64_t ssid = subscribe(subject, queue, handler);
+
+        if(dispatcher)
+            find_subscription(ssid)->strand = dispatcher->create_strand(handler);
+
+        return ssid;
+    }
+
+    inline uint64_t Client::subscribe(const QString &subject, const QString &queue, MessageHandler handler)
+    {
+        m_subscriptions.append(std::make_shared<SubscriptionData>());
+        m_subscriptions_live++;
+        ++m_ssid;
+
+        SubscriptionData &subscription = *m_subscriptions.last();
+        subscription.subject = subject.toUtf8();
+        subscription.queue = queue.toUtf8();
+        subscription.handler = handler;
+        subscription.pending_msgs_limit = m_options.pending_msgs_limit;
+        subscription.pending_bytes_limit = m_options.pending_bytes_limit;
+
+        // subscriptions made while not connected are sent with CONNECT
+        if(!m_connected)
+            return m_ssid;
+
+        QString message = QStringLiteral("SUB ") % subject % " " % queue % (queue.isEmpty() ? "" : " ") % QString::number(m_ssid) % CLRF;
+
+        m_outbound.append(message.toUtf8());
+        schedule_flush();
+
+        DEBUG_PROTOCOL("subscribed:" << message);
+
+        return m_ssid;
+    }
+
+    inline Subscription *Client::subscribe(const QString &subject)
+    {
+        auto subscription = new Subscription;
+
+        subscription->ssid = subscribe(subject, QString(), [subscription](const Message &message)
+        {
+            subscription->enqueue(message);
+        });
+
+        // messages nobody took yet count against subscription pending limits
+        find_subscription(subscription->ssid)->notifier = subscription;
+
+        // deleting subscription object ends subscription
+        QObject::connect(subscription, &QObject::destroyed, this, [this, ssid = subscription->ssid]
+        {
+            unsubscribe(ssid);
+        });
+
+        return subscription;
+    }
+
+    inline void Client::unsubscribe(uint64_t ssid, int max_messages)
+    {
+        if(SubscriptionData *subscription = find_subscription(ssid).get())
+        {
+            // with limit, messages already received are still delivered
+            if(max_messages > 0)
+                subscription->max = uint64_t(max_messages);
+
+            if(max_messages <= 0 || (subscription->delivered >= subscription->max && subscription->pending.isEmpty()))
+            {
+                if(subscription->strand && max_messages <= 0)
+                    subscription->strand->closed = true;
+
+                remove_subscription(ssid);
+            }
+        }
+
+        if(!m_connected)
+            return;
+
+        QString message = QStringLiteral("UNSUB ") % QString::number(ssid) % (max_messages > 0 ? QString(" %1").arg(max_messages) : "") % CLRF;
+
+        DEBUG_PROTOCOL("unsubscribed:" << message);
+
+        m_outbound.append(message.toUtf8());
+        schedule_flush();
+    }
+
+    inline void Client::setPendingLimits(uint64_t ssid, int max_messages, qint64 max_bytes)
+    {
+        SubscriptionData *subscription = find_subscription(ssid).get();
+        if(!subscription)
+            return;
+
+        subscription->pending_msgs_limit = max_messages;
+        subscription->pending_bytes_limit = max_bytes;
+    }
+
+    inline int Client::pendingMessages(uint64_t ssid) const
+    {
+        const SubscriptionData *subscription = find_subscription(ssid).get();
+        return subscription ? int(subscription->pending.size()) : 0;
+    }
+
+    inline uint64_t Client::droppedMessages(uint64_t ssid) const
+    {
+        const SubscriptionData *subscription = find_subscription(ssid).get();
+        return subscription ? subscription->dropped : 0;
+    }
+
+    inline const std::shared_ptr<Client::SubscriptionData> &Client::find_subscription(uint64_t ssid) const
+    {
+        static const std::shared_ptr<SubscriptionData> none;
+
+        if(ssid >= m_subscriptions_base && ssid - m_subscriptions_base < uint64_t(m_subscriptions.size()))
+            return m_subscriptions.at(qsizetype(ssid - m_subscriptions_base));
+
+        if(m_old_subscriptions.isEmpty())
+            return none;
+
+        auto it = m_old_subscriptions.constFind(ssid);
+        return it == m_old_subscriptions.constEnd() ? none : it.value();
+    }
+
+    inline void Client::remove_subscription(uint64_t ssid)
+    {
+        if(ssid < m_subscriptions_base || ssid - m_subscriptions_base >= uint64_t(m_subscriptions.size()))
+        {
+            m_old_subscriptions.remove(ssid);
+            return;
+        }
+
+        std::shared_ptr<SubscriptionData> &slot = m_subscriptions[qsizetype(ssid - m_subscriptions_base)];
+        if(!slot)
+            return;
+
+        slot.reset();
+        m_subscriptions_live--;
+
+        // later ssids keep their slots, only the front can be reclaimed
+        while(!m_subscriptions.isEmpty() && !m_subscriptions.first())
+        {
+            m_subscriptions.removeFirst();
+            m_subscriptions_base++;
+        }
+
+        // early long-lived subscription pins the front, move survivors aside and start over
+        if(m_subscriptions.size() >= 64 && m_subscriptions_live * 4 < m_subscriptions.size())
+        {
+            for(qsizetype i = 0; i < m_subscriptions.size(); ++i)
+            {
+                if(m_subscriptions[i])
+                    m_old_subscriptions.insert(m_subscriptions_base + uint64_t(i), std::move(m_subscriptions[i]));
+            }
+
+            m_subscriptions_base += uint64_t(m_subscriptions.size());
+            m_subscriptions.clear();
+            m_subscriptions_live = 0;
+        }
+    }
+
+    inline uint64_t Client::request(const QString subject, MessageCallback callback)
+    {
+        return request(subject, "", callback);
+    }
+
+    inline uint64_t Client::request(const QString subject, const QString message, MessageCallback callback)
+    {
+        return request(subject.toUtf8(), message.toUtf8(), [callback](const Message &reply)
+        {
+            callback(QString::fromUtf8(reply.payload), QString::fromUtf8(reply.reply), QString::fromUtf8(reply.subject));
+        });
+    }
+
+    inline uint64_t Client::request(QByteArrayView subject, QByteArrayView payload, MessageHandler handler, int timeout, ErrorCallback error)
+    {
+        return request(subject, Headers(), payload, handler, timeout, error);
+    }
+
+    // new style request, '_INBOX.<id>.*' is subscribed once and each request gets its own token
+    inline uint64_t Client::request(QByteArrayView subject, const Headers &headers, QByteArrayView payload, MessageHandler handler, int timeout, ErrorCallback error)
+    {
+        Response response;
+        response.handler = std::move(handler);
+        response.error = std::move(error);
+
+        return start_request(subject, headers, payload, std::move(response), timeout);
+    }
+
+    inline uint64_t Client::requestMany(QByteArrayView subject, QByteArrayView payload, int max_replies, int timeout, int stall_timeout,
+                                        MessageHandler handler, FlushCallback finished)
+    {
+        // fewer responders than max_replies and no reply to start stall timer would keep it forever
+        if(timeout <= 0)
+        {
+            qWarning() << "requestMany needs timeout";
+            return 0;
+        }
+
+        Response response;
+        response.handler = std::move(handler);
+        response.many = true;
+        response.max_replies = max_replies;
+        response.stall = stall_timeout;
+        response.finished = std::move(finished);
+
+        return start_request(subject, Headers(), payload, std::move(response), timeout);
+    }
+
+    inline uint64_t Client::requestMany(QByteArrayView subject, QByteArrayView payload, int max_replies, int timeout, int stall_timeout,
+                                        RepliesHandler handler)
+    {
+        auto replies = std::make_shared<QList<Message>>();
+
+        return requestMany(subject, payload, max_replies, timeout, stall_timeout, [replies](const Message &message)
+        {
+            // kept after read buffer is reused
+            Message reply = message;
+            reply.detach();
+
+            replies->append(std::move(reply));
+        }, [replies, handler]
+        {
+            if(handler)
+                handler(*replies);
+        });
+    }
+
+    inline uint64_t Client::start_request(QByteArrayView subject, const Headers &headers, QByteArrayView payload, Response response, int timeout)
+    {
+        if(m_resp_ssid == 0)
+        {
+            m_resp_prefix = newInbox() + '.';
+            m_resp_ssid = subscribe(QString::fromLatin1(m_resp_prefix + '*'), [this](const Message &message)
+            {
+                process_response(message);
+            });
+        }
+
+        const uint64_t token = ++m_resp_token;
+
+        QByteArray inbox;
+        inbox.reserve(m_resp_prefix.size() + 20);
+        inbox.append(m_resp_prefix);
+        append_number(inbox, token);
+
+        response.sent = m_options.latency_histograms ? m_clock.nsecsElapsed() / 1000 : 0;
+
+        // over max_payload, reconnect buffer full or headers not supported, no reply can come
+        if(!publishBytes(subject, headers, payload, inbox))
+        {
+            if(response.many)
+            {
+                if(response.finished)
+                    response.finished();
+            }
+            else if(response.error)
+            {
+                response.error(QStringLiteral("publish failed"));
+            }
+
+            return 0;
+        }
+
+        m_responses.insert(token, std::move(response));
+
+        if(timeout > 0)
+        {
+            QTimer::singleShot(timeout, this, [this, token]
+            {
+                auto it = m_responses.find(token);
+                if(it == m_responses.end())
+                    return;
+
+                DEBUG_DISPATCH("request timeout:" << token);
+
+                // deadline is a regular end of collecting replies
+                if(it->many)
+                {
+                    finish_request(token);
+                    return;
+                }
+
+                ErrorCallback error = it->error;
+                m_responses.erase(it);
+
+                if(error)
+                    error(QStringLiteral("request timeout"));
+            });
+        }
+
+        return token;
+    }
+
+    inline void Client::cancelRequest(uint64_t id)
+    {
+        m_responses.remove(id);
+    }
+
+    inline void Client::fail_requests(const QString &error)
+    {
+        // callbacks can make new requests
+        const QHash<uint64_t, Response> responses = std::exchange(m_responses, {});
+
+        for(const Response &response : responses)
+        {
+            if(response.many)
+            {
+                if(response.finished)
+                    response.finished();
+            }
+            else if(response.error)
+            {
+                response.error(error);
+            }
+        }
+    }
+
+    inline void Client::finish_request(uint64_t token)
+    {
+        auto it = m_responses.find(token);
+        if(it == m_responses.end())
+            return;
+
+        const FlushCallback finished = std::move(it->finished);
+        m_responses.erase(it);
+
+        if(finished)
+            finished();
+    }
+
+    inline QByteArray Client::newInbox()
+    {
+        QByteArray inbox(7 + Nuid::length, Qt::Uninitialized);
+        memcpy(inbox.data(), "_INBOX.", 7);
+        m_nuid.next(inbox.data() + 7);
+
+        return inbox;
+    }
+
+    inline void Client::process_response(const Message &message)
+    {
+        if(message.subject.size() <= m_resp_prefix.size())
+            return;
+
+        const int64_t token = Parser::parse_uint(QByteArrayView(message.subject).sliced(m_resp_prefix.size()));
+
+        auto it = m_responses.find(uint64_t(token));
+        if(token < 0 || it == m_responses.end())
+        {
+            DEBUG_DISPATCH("reply for unknown request:" << message.subject);
+            return;
+        }
+
+        if(m_options.latency_histograms && it->replies == 0)
+            m_request_latency.record(m_clock.nsecsElapsed() / 1000 - it->sent);
+
+        // server replies with status only message if subject has no subscribers
+        const bool no_responders = message.payload.isEmpty() && message.headers.status() == 503;
+
+        if(it->many)
+        {
+            if(no_responders)
+            {
+                DEBUG_DISPATCH("no responders:" << token);
+
+                finish_request(uint64_t(token));
+                return;
+            }
+
+            const int replies = ++it->replies;
+
+            // handler can make requests, entry may move
+            const MessageHandler handler = it->handler;
+
+            if(it->max_replies > 0 && replies >= it->max_replies)
+            {
+                const FlushCallback finished = std::move(it->finished);
+                m_responses.erase(it);
+
+                if(handler)
+                    handler(message);
+
+                if(finished)
+                    finished();
+
+                return;
+            }
+
+            // stall timer restarts with every reply, stale ones see a different count
+            if(it->stall > 0)
+            {
+                QTimer::singleShot(it->stall, this, [this, token, replies]
+                {
+                    auto entry = m_responses.constFind(uint64_t(token));
+                    if(entry == m_responses.constEnd() || entry->replies != replies)
+                        return;
+
+                    DEBUG_DISPATCH("request stalled:" << token);
+
+                    finish_request(uint64_t(token));
+                });
+            }
+
+            if(handler)
+                handler(message);
+
+            return;
+        }
+
+        const Response response = it.value();
+        m_responses.erase(it);
+
+        if(no_responders)
+        {
+            DEBUG_DISPATCH("no responders:" << token);
+
+            if(response.error)
+                response.error(QStringLiteral("no responders"));
+
+            return;
+        }
+
+        if(response.handler)
+            response.handler(message);
+    }
+
+    inline Statistics Client::statistics() const
+    {
+        Statistics statistics;
+        statistics.in_msgs = m_counters.in_msgs.load(std::memory_order_relaxed);
+        statistics.in_bytes = m_counters.in_bytes.load(std::memory_order_relaxed);
+        statistics.out_msgs = m_counters.out_msgs.load(std::memory_order_relaxed);
+        statistics.out_bytes = m_counters.out_bytes.load(std::memory_order_relaxed);
+        statistics.reconnects = m_counters.reconnects.load(std::memory_order_relaxed);
+        statistics.parse_errors = m_counters.parse_errors.load(std::memory_order_relaxed);
+        statistics.max_buffered_bytes = m_counters.max_buffered_bytes.load(std::memory_order_relaxed);
+        statistics.request_latency = m_request_latency;
+        statistics.callback_latency = m_callback_latency;
+
+        // subscription table belongs to client thread
+        if(QThread::currentThread() != thread())
+            return statistics;
+
+        for_each_subscription([&statistics](uint64_t ssid, const SubscriptionData &subscription)
+        {
+            SubscriptionStatistics entry;
+            entry.ssid = ssid;
+            entry.subject = subscription.subject;
+            entry.queue = subscription.queue;
+            entry.delivered = subscription.delivered;
+            entry.dropped = subscription.dropped;
+            entry.pending_msgs = subscription.pending.size();
+            entry.pending_bytes = subscription.pending_bytes;
+
+            if(subscription.strand)
+            {
+                entry.pending_msgs += subscription.strand->pending_msgs.load(std::memory_order_relaxed);
+                entry.pending_bytes += subscription.strand->pending_bytes.load(std::memory_order_relaxed);
+            }
+
+            statistics.subscriptions.append(entry);
+        });
+
+        return statistics;
+    }
+
+    inline void Client::flush(FlushCallback callback)
+    {
+        if(callback)
+            send_ping(callback);
+
+        // anything written before CONNECT is kept until connection is established
+        if(!m_connected || m_outbound.isEmpty())
+            return;
+
+        const qint64 buffered = m_outbound.size() + m_socket.bytesToWrite();
+        if(buffered > m_counters.max_buffered_bytes.load(std::memory_order_relaxed))
+            m_counters.max_buffered_bytes.store(buffered, std::memory_order_relaxed);
+
+        m_socket.write(m_outbound);
+
+        // keep capacity for next batch of frames
+        m_outbound.resize(0);
+    }
+
+    inline bool Client::flushSync(int timeout)
+    {
+        if(!m_connected)
+            return false;
+
+        auto done = std::make_shared<bool>(false);
+        flush([done] { *done = true; });
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // readyRead is emitted from waitForReadyRead so PONG goes through regular listeners
+        while(!*done && m_connected)
+        {
+            const qint64 remaining = timeout - timer.elapsed();
+            if(remaining <= 0 || !m_socket.waitForReadyRead(int(remaining)))
+                break;
+        }
+
+        return *done;
+    }
+
+    inline qint64 Client::rtt() const
+    {
+        return m_rtt;
+    }
+
+    inline void Client::send_ping(FlushCallback callback)
+    {
+        m_outbound.append("PING\r\n", 6);
+        m_pongs.enqueue(PendingPong{callback, m_clock.nsecsElapsed()});
+    }
+
+    inline void Client::process_ping_timer()
+    {
+        if(!m_connected)
+            return;
+
+        // half-open connections are never reported by the socket, close it so we can reconnect
+        if(++m_pings_out > m_options.max_pings_out)
+        {
+            qWarning() << "stale connection," << m_pings_out - 1 << "PINGs without PONG";
+
+            emit error(QStringLiteral("stale connection"));
+            m_socket.abort();
+            return;
+        }
+
+        DEBUG_PROTOCOL("sending ping");
+
+        send_ping(nullptr);
+        flush();
+    }
+
+    inline void Client::schedule_flush()
+    {
+        if(m_outbound.size() >= m_options.flush_threshold)
+        {
+            flush();
+            return;
+        }
+
+        if(m_flush_scheduled)
+            return;
+
+        m_flush_scheduled = true;
+        QMetaObject::invokeMethod(this, [this]
+        {
+            m_flush_scheduled = false;
+            flush();
+        }, Qt::QueuedConnection);
+    }
+
+    inline void Client::set_listeners()
+    {
+        DEBUG_CONNECTION("set listeners");
+
+        m_parser.reset();
+        m_parser.setMaxReserve(qMax(1024, m_options.max_read_buffer_size));
+
+        m_pings_out = 0;
+        if(m_options.ping_interval > 0)
+            m_ping_timer.start(m_options.ping_interval);
+
+        // INFO is parsed by now, whole message up to max_payload fits one read
+        const qint64 minimum = qMax(1024, m_options.read_buffer_size);
+        const qint64 size = qBound(minimum, m_max_payload.load(std::memory_order_relaxed), qMax(minimum, qint64(m_options.max_read_buffer_size)));
+
+        if(m_read_buffer.size() != size)
+        {
+            // reconnected from callback of a read on previous connection, its messages still reference the buffer
+            if(m_reading)
+                m_retired_buffers.append(m_read_buffer);
+
+            m_read_buffer = QByteArray(qsizetype(size), Qt::Uninitialized);
+        }
+
+        QObject::connect(&m_socket, &QSslSocket::readyRead, this, [this]
+        {
+            // callback of the current read is waiting synchronously (flushSync, processEvents)
+            const bool nested = m_reading;
+            if(nested)
+            {
+                // parser is in the middle of current read, the rest of it has to be parsed first
+                if(m_parsing)
+                    return;
+
+                // message being delivered and the ones after it still reference buffer of outer read,
+                // following nested reads leave everything detached and can share the new one
+                if(m_retired_buffers.isEmpty())
+                    m_retired_buffers.append(std::exchange(m_read_buffer, QByteArray(m_read_buffer.size(), Qt::Uninitialized)));
+            }
+
+            m_reading = true;
+
+            // parser keeps partial operations between reads so the same buffer is refilled each time
+            forever
+            {
+                const qint64 read = m_socket.read(m_read_buffer.data(), m_read_buffer.size());
+                if(read <= 0)
+                    break;
+
+                m_parsing = true;
+                const bool parsed = m_parser.parse(QByteArray::fromRawData(m_read_buffer.constData(), read), *this);
+                m_parsing = false;
+
+                // messages reference buffer, deliver or detach them before it is overwritten
+                dispatch();
+
+                if(!parsed)
+                {
+                    qCritical() << m_parser.error();
+
+                    m_counters.parse_errors.fetch_add(1, std::memory_order_relaxed);
+
+                    emit error(m_parser.error());
+                    m_socket.close();
+                    break;
+                }
+            }
+
+            m_reading = nested;
+
+            // outer dispatch is done, nothing references replaced buffers anymore
+            if(!nested)
+                m_retired_buffers.clear();
+        });
+    }
+
+    inline void Client::process_msg(const MsgArg &args, const QByteArray &headers, const QByteArray &payload)
+    {
+        DEBUG_PROTOCOL("message:" << args.subject << args.ssid << args.reply << headers << payload);
+
+        m_counters.in_msgs.fetch_add(1, std::memory_order_relaxed);
+        m_counters.in_bytes.fetch_add(quint64(payload.size()), std::memory_order_relaxed);
+
+        SubscriptionData *found = find_subscription(args.ssid).get();
+        if(!found)
+        {
+            qWarning() << "invalid callback";
+            return;
+        }
+
+        SubscriptionData &subscription = *found;
+
+        // auto unsubscribe limit reached, anything after it is late
+        if(subscription.max > 0 && subscription.delivered >= subscription.max)
+            return;
+
+        // messages handed over to dispatcher count as pending until delivered
+        qint64 pending_msgs = subscription.pending.size();
+        qint64 pending_bytes = subscription.pending_bytes;
+
+        if(subscription.strand)
+        {
+            pending_msgs += subscription.strand->pending_msgs.load(std::memory_order_relaxed);
+            pending_bytes += subscription.strand->pending_bytes.load(std::memory_order_relaxed);
+        }
+
+        if(subscription.notifier)
+        {
+            pending_msgs += subscription.notifier->m_messages.size();
+            pending_bytes += subscription.notifier->m_bytes;
+        }
+
+        // slow consumer, drop message instead of growing without bound
+        if((subscription.pending_msgs_limit >= 0 && pending_msgs >= subscription.pending_msgs_limit)
+                || (subscription.pending_bytes_limit >= 0 && pending_bytes + payload.size() > subscription.pending_bytes_limit))
+        {
+            // server counts dropped messages toward auto unsubscribe limit too
+            subscription.delivered++;
+
+            // nothing left to hand over, server already removed subscription on its own
+            // decided before reporting since slowConsumer slot can unsubscribe
+            const bool finished = subscription.max > 0 && subscription.delivered >= subscription.max && subscription.pending.isEmpty();
+
+            report_slow_consumer(subscription, args.ssid);
+
+            if(finished)
+                remove_subscription(args.ssid);
+
+            return;
+        }
+
+        subscription.delivered++;
+        subscription.slow = false;
+
+        // messages kept past the read buffer share subscription subject instead of copying it
+        Message message;
+        message.subject = (args.subject == subscription.subject) ? subscription.subject : args.subject;
+        message.reply = args.reply;
+        message.payload = payload;
+        message.ssid = args.ssid;
+
+        if(!headers.isEmpty())
+            message.headers = Headers(headers);
+
+        subscription.pending.enqueue(std::move(message));
+        subscription.pending_bytes += payload.size();
+        subscription.raw++;
+
+        if(!subscription.ready)
+        {
+            subscription.ready = true;
+            m_ready.enqueue(args.ssid);
+        }
+    }
+
+    inline void Client::report_slow_consumer(SubscriptionData &subscription, uint64_t ssid)
+    {
+        subscription.dropped++;
+
+        if(subscription.slow)
+            return;
+
+        subscription.slow = true;
+        qWarning() << "slow consumer on subscription" << ssid;
+
+        emit slowConsumer(ssid);
+    }
+
+    inline void Client::dispatch()
+    {
+        // callback waiting synchronously (flushSync) got here through readyRead, keep ordering
+        // by leaving delivery to the outer dispatch
+        if(!m_dispatching)
+        {
+            m_dispatching = true;
+
+            const qint64 deadline = m_clock.elapsed() + m_options.dispatch_slice;
+            bool expired = false;
+
+            while(!m_ready.isEmpty() && !expired)
+            {
+                const uint64_t ssid = m_ready.dequeue();
+
+                // callback can unsubscribe, shared copy keeps handler alive while it runs
+                const std::shared_ptr<SubscriptionData> subscription = find_subscription(ssid);
+                if(!subscription)
+                    continue;
+
+                // worker threads outlive the read buffer, hand everything over at once
+                if(subscription->strand)
+                {
+                    for(qsizetype i = subscription->pending.size() - subscription->raw; i < subscription->pending.size(); ++i)
+                        subscription->pending[i].detach();
+
+                    Dispatcher::post(subscription->strand, std::move(subscription->pending), subscription->pending_bytes);
+
+                    subscription->pending = QQueue<Message>();
+                    subscription->pending_bytes = 0;
+                    subscription->raw = 0;
+                    subscription->ready = false;
+
+                    if(subscription->max > 0 && subscription->delivered >= subscription->max)
+                        remove_subscription(ssid);
+
+                    continue;
+                }
+
+                bool removed = false;
+                m_delivering = ssid;
+
+                while(!subscription->pending.isEmpty())
+                {
+                    Message message = subscription->pending.dequeue();
+                    subscription->pending_bytes -= message.payload.size();
+                    subscription->raw = qMin(subscription->raw, subscription->pending.size());
+
+                    // auto unsubscribe limit reached, server removes subscription on its own
+                    if(subscription->max > 0 && subscription->delivered >= subscription->max && subscription->pending.isEmpty())
+                        remove_subscription(ssid);
+
+                    if(m_options.latency_histograms)
+                    {
+                        const qint64 started = m_clock.nsecsElapsed();
+                        subscription->handler(message);
+                        m_callback_latency.record((m_clock.nsecsElapsed() - started) / 1000);
+                    }
+                    else
+                    {
+                        subscription->handler(message);
+                    }
+
+                    // callbacks can add or remove subscriptions
+                    if(find_subscription(ssid) != subscription)
+                    {
+                        removed = true;
+                        break;
+                    }
+
+                    if(m_clock.elapsed() >= deadline)
+                    {
+                        expired = true;
+                        break;
+                    }
+                }
+
+                m_delivering = 0;
+
+                if(removed)
+                    continue;
+
+                if(subscription->pending.isEmpty())
+                    subscription->ready = false;
+                else
+                {
+                    // go to the back so other subscriptions get their turn in next pass
+                    m_ready.enqueue(ssid);
+                }
+            }
+
+            m_dispatching = false;
+        }
+        else if(m_delivering)
+        {
+            // nested read added to subscription being delivered, it is not in m_ready until its callback returns
+            detach_pending(m_delivering);
+        }
+
+        if(m_ready.isEmpty())
+            return;
+
+        // the rest waits for next event loop iteration and can't reference the read buffer anymore
+        for(const uint64_t ssid : std::as_const(m_ready))
+            detach_pending(ssid);
+
+        if(m_dispatch_scheduled)
+            return;
+
+        m_dispatch_scheduled = true;
+        QMetaObject::invokeMethod(this, [this]
+        {
+            m_dispatch_scheduled = false;
+            dispatch();
+        }, Qt::QueuedConnection);
+    }
+
+    inline void Client::detach_pending(uint64_t ssid)
+    {
+        SubscriptionData *subscription = find_subscription(ssid).get();
+        if(!subscription)
+            return;
+
+        for(qsizetype i = subscription->pending.size() - subscription->raw; i < subscription->pending.size(); ++i)
+            subscription->pending[i].detach();
+
+        subscription->raw = 0;
+    }
+
+    inline void Client::process_ping()
+    {
+        DEBUG_PROTOCOL("sending pong");
+
+        m_outbound.append("PONG\r\n", 6);
+        schedule_flush();
+    }
+
+    inline void Client::process_pong()
+    {
+        DEBUG_PROTOCOL("pong");
+
+        // any PONG means connection is alive
+        m_pings_out = 0;
+
+        if(m_pongs.isEmpty())
+            return;
+
+        PendingPong pong = m_pongs.dequeue();
+        m_rtt = (m_clock.nsecsElapsed() - pong.sent) / 1000;
+
+        if(pong.callback)
+            pong.callback();
+    }
+
+    inline void Client::process_ok()
+    {
+        DEBUG_PROTOCOL("+OK");
+    }
+
+    // -ERR <error message>, all errors except invalid subject close the connection
+    inline void Client::process_err(QByteArrayView message)
+    {
+        QString error_message = QString::fromUtf8(message.data(), message.size()).trimmed();
+        if(error_message.startsWith('\'') && error_message.endsWith('\''))
+            error_message = error_message.mid(1, error_message.length() - 2);
+
+        qCritical() << "error" << error_message;
+
+        emit error(error_message);
+
+        if(error_message.compare(QStringLiteral("Invalid Subject"), Qt::CaseInsensitive) != 0)
+            m_socket.close();
+    }
+
+    // asynchronous INFO sent by server after connection is established, cluster topology updates
+    inline void Client::process_info(QByteArrayView message)
+    {
+        DEBUG_PROTOCOL("info:" << message);
+
+        const QJsonObject json = QJsonDocument::fromJson(QByteArray(message.data(), message.size())).object();
+
+        if(json.contains(QStringLiteral("max_payload")))
+        {
+            m_max_payload = json.value(QStringLiteral("max_payload")).toInteger(0);
+            m_parser.setMaxPayload(qsizetype(m_max_payload.load()));
+        }
+
+        add_servers(json);
+    }
+
+    //!
+    //! \brief The Router class
+    //! fans messages of one server subscription, like 'orders.>', out to local routes
+    //! keeps server side subscription count and interest traffic small with thousands of subjects
+    //! must be used from client thread
+    class Router
+    {
+    public:
+        Router(Client *client, const QString &subject, const QString &queue = QString());
+        ~Router();
+
+        Router(const Router &) = delete;
+        Router &operator=(const Router &) = delete;
+
+        //!
+        //! \brief route
+        //! \param subject
+        //! \param handler
+        //! \return route id, 0 if subject is not valid
+        //! deliver messages matching subject, '*' and '>' wildcards are supported
+        uint64_t route(QByteArrayView subject, Nats::MessageHandler handler);
+
+        void unroute(uint64_t id);
+
+    private:
+
+        void process_message(const Message &message);
+
+        struct Route
+        {
+            QByteArray subject;
+
+            //! shared so handler can remove its own route
+            std::shared_ptr<MessageHandler> handler;
+        };
+
+        //!
+        //! \brief m_client
+        QPointer<Client> m_client;
+
+        //!
+        //! \brief m_ssid
+        //! server subscription all routes share
+        uint64_t m_ssid = 0;
+
+        //!
+        //! \brief m_sublist
+        //! route ids by subject
+        Sublist m_sublist;
+
+        //!
+        //! \brief m_routes
+        QHash<uint64_t, Route> m_routes;
+        uint64_t m_route_id = 0;
+    };
+
+    inline Router::Router(Client *client, const QString &subject, const QString &queue) :
+        m_client(client)
+    {
+        m_ssid = client->subscribe(subject, queue, [this](const Message &message)
+        {
+            process_message(message);
+        });
+    }
+
+    inline Router::~Router()
+    {
+        if(m_client)
+            m_client->unsubscribe(m_ssid);
+    }
+
+    inline uint64_t Router::route(QByteArrayView subject, MessageHandler handler)
+    {
+        const uint64_t id = ++m_route_id;
+
+        if(!m_sublist.insert(subject, id))
+        {
+            qWarning() << "invalid route subject:" << subject;
+            return 0;
+        }
+
+        m_routes.insert(id, Route{subject.toByteArray(), std::make_shared<MessageHandler>(std::move(handler))});
+
+        return id;
+    }
+
+    inline void Router::unroute(uint64_t id)
+    {
+        auto it = m_routes.find(id);
+        if(it == m_routes.end())
+            return;
+
+        m_sublist.remove(it->subject, id);
+        m_routes.erase(it);
+    }
+
+    inline void Router::process_message(const Message &message)
+    {
+        // handlers can change routes, result is a shared copy
+        const QList<uint64_t> ids = m_sublist.match(message.subject);
+
+        for(const uint64_t id : ids)
+        {
+            auto it = m_routes.constFind(id);
+            if(it == m_routes.constEnd())
+                continue;
+
+            const std::shared_ptr<MessageHandler> handler = it->handler;
+            (*handler)(message);
+        }
+    }
+
+    //!
+    //! \brief The PubAck struct
+    //! acknowledgement of message stored by JetStream
+    struct PubAck
+    {
+        QByteArray stream;
+        uint64_t sequence = 0;
+
+        //! message with the same Nats-Msg-Id was already stored
+        bool duplicate = false;
+        QByteArray domain;
+    };
+
+    using PubAckCallback = std::function<void(const Nats::PubAck &ack)>;
+
+    //!
+    //! \brief The JetStreamOptions struct
+    struct JetStreamOptions
+    {
+        //! prefix of JetStream API subjects, differs for domains and imported accounts
+        QByteArray api_prefix = "$JS.API";
+
+        //! publishes waiting for acknowledgement, further publishes are queued locally until acks arrive
+        //! -1 for no limit
+        int max_pending = 4000;
+
+        //! time to wait for acknowledgement (ms)
+        int timeout = 5000;
+    };
+
+    //!
+    //! \brief The PullOptions struct
+    //! options of pull consumer fetches
+    struct PullOptions
+    {
+        //! messages requested by one fetch
+        int batch = 100;
+
+        //! byte limit of one fetch, 0 for no limit
+        qint64 max_bytes = 0;
+
+        //! time server keeps fetch open waiting for messages (ms), must be positive so lost fetches get replaced
+        int expires = 30000;
+
+        //! fetches kept in flight, next one is already waiting while previous is processed
+        int prefetch = 2;
+    };
+
+    class PullConsumer;
+
+    //!
+    //! \brief The JetStream class
+    //! JetStream context using given client, must be used from client thread
+    //! publishes are pipelined and acknowledged through client request inbox
+    class JetStream : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit JetStream(Client *client, const JetStreamOptions &options = JetStreamOptions());
+
+        //!
+        //! \brief publishAsync
+        //! \param subject
+        //! \param payload
+        //! \param ack
+        //! \param error
+        //! publish message to stream without waiting for acknowledgement of previous one,
+        //! ack callback fires once message is stored, error callback on API error, timeout or no responders
+        void publishAsync(QByteArrayView subject, QByteArrayView payload, Nats::PubAckCallback ack = nullptr, Nats::ErrorCallback error = nullptr);
+        void publishAsync(QByteArrayView subject, const Nats::Headers &headers, QByteArrayView payload, Nats::PubAckCallback ack = nullptr, Nats::ErrorCallback error = nullptr);
+
+        //!
+        //! \brief pendingAcks
+        //! \return number of publishes sent or queued and not yet acknowledged
+        int pendingAcks() const;
+
+        //!
+        //! \brief publishAsyncComplete
+        //! \param callback
+        //! callback fires once all pending publishes are acknowledged or failed
+        void publishAsyncComplete(Nats::FlushCallback callback);
+
+        //!
+        //! \brief pullSubscribe
+        //! \param stream
+        //! \param consumer
+        //! \param handler
+        //! \param options
+        //! \return consumer owned by context
+        //! start fetching messages of existing durable pull consumer
+        Nats::PullConsumer *pullSubscribe(QByteArrayView stream, QByteArrayView consumer, Nats::MessageHandler handler, const Nats::PullOptions &options = PullOptions());
+
+        //!
+        //! \brief ack
+        //! acknowledge message, acknowledgements are written together with other pending output
+        void ack(const Nats::Message &message);
+
+        //!
+        //! \brief nak
+        //! negatively acknowledge message, it is redelivered
+        void nak(const Nats::Message &message);
+
+        //!
+        //! \brief term
+        //! message is never redelivered
+        void term(const Nats::Message &message);
+
+        //!
+        //! \brief inProgress
+        //! reset redelivery timer of message still being processed
+        void inProgress(const Nats::Message &message);
+
+        //!
+        //! \brief parsePubAck
+        //! \return true if payload is valid acknowledgement, otherwise error contains API error
+        static bool parsePubAck(const QByteArray &payload, Nats::PubAck &ack, QString &error);
+
+    private:
+
+        struct Publish
+        {
+            QByteArray subject;
+            Headers headers;
+            QByteArray payload;
+            PubAckCallback ack;
+            ErrorCallback error;
+        };
+
+        //!
+        //! \brief send
+        //! send publish as request, reply inbox is shared by all requests of the client
+        void send(QByteArrayView subject, const Headers &headers, QByteArrayView payload, PubAckCallback ack, ErrorCallback error);
+
+        //!
+        //! \brief complete
+        //! release window slot and send queued publishes
+        void complete();
+
+        //!
+        //! \brief m_client
+        QPointer<Client> m_client;
+
+        //!
+        //! \brief m_options
+        JetStreamOptions m_options;
+
+        //!
+        //! \brief m_in_flight
+        //! publishes sent and waiting for acknowledgement
+        int m_in_flight = 0;
+
+        //! complete() is draining the queue, publish rejected right away completes from within send()
+        bool m_completing = false;
+
+        //!
+        //! \brief m_queue
+        //! publishes waiting for free slot in pending window
+        QQueue<Publish> m_queue;
+
+        //!
+        //! \brief m_complete_callbacks
+        //! publishAsyncComplete callbacks waiting for window to empty
+        QList<FlushCallback> m_complete_callbacks;
+    };
+
+    //!
+    //! \brief The PullConsumer class
+    //! keeps PullOptions::prefetch fetches of durable consumer in flight on its own inbox
+    //! all fetches share one subscription, received messages are counted against oldest fetch
+    class PullConsumer : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        ~PullConsumer() override
+        {
+            stop();
+        }
+
+        //!
+        //! \brief stop
+        //! unsubscribe inbox, fetches still open on server expire on their own
+        void stop();
+
+        bool isActive() const;
+
+        //!
+        //! \brief delivered
+        //! \return number of messages delivered to handler
+        uint64_t delivered() const;
+
+    signals:
+
+        //!
+        //! \brief error
+        //! consumer can not continue, like when it was deleted, consumer is stopped
+        void error(const QString);
+
+    private:
+        friend class JetStream;
+
+        PullConsumer(Client *client, const QByteArray &subject, MessageHandler handler, const PullOptions &options, QObject *parent);
+
+        void start();
+
+        //!
+        //! \brief fetch
+        //! send CONSUMER.MSG.NEXT requests until prefetch fetches are in flight
+        void fetch();
+
+        void process_message(const Message &message);
+        void process_status(const Message &message, int status);
+
+        //!
+        //! \brief process_expired
+        //! drop fetches server did not answer, like ones lost with connection
+        void process_expired();
+
+        struct Fetch
+        {
+            uint64_t token;
+            int remaining;
+            qint64 remaining_bytes;
+            qint64 sent;
+        };
+
+        //!
+        //! \brief m_client
+        QPointer<Client> m_client;
+
+        //!
+        //! \brief m_subject
+        //! '<prefix>.CONSUMER.MSG.NEXT.<stream>.<consumer>'
+        QByteArray m_subject;
+
+        //!
+        //! \brief m_request
+        //! fetch request payload, same for every fetch
+        QByteArray m_request;
+
+        //!
+        //! \brief m_inbox
+        //! '_INBOX.<id>.', fetch token is appended to it
+        QByteArray m_inbox;
+
+        MessageHandler m_handler;
+        PullOptions m_options;
+
+        //!
+        //! \brief m_fetches
+        //! open fetches, oldest first
+        QQueue<Fetch> m_fetches;
+        uint64_t m_token = 0;
+        uint64_t m_ssid = 0;
+        uint64_t m_delivered = 0;
+
+        //!
+        //! \brief m_expired_timer
+        //! checks for fetches not answered within expiration
+        QTimer m_expired_timer;
+        QElapsedTimer m_clock;
+    };
+
+    inline JetStream::JetStream(Client *client, const JetStreamOptions &options) :
+        QObject(client),
+        m_client(client),
+        m_options(options)
+    {
+    }
+
+    inline void JetStream::publishAsync(QByteArrayView subject, QByteArrayView payload, PubAckCallback ack, ErrorCallback error)
+    {
+        publishAsync(subject, Headers(), payload, ack, error);
+    }
+
+    inline void JetStream::publishAsync(QByteArrayView subject, const Headers &headers, QByteArrayView payload, PubAckCallback ack, ErrorCallback error)
+    {
+        // keep ordering, nothing overtakes queued publishes
+        if((m_options.max_pending < 0 || m_in_flight < m_options.max_pending) && m_queue.isEmpty())
+        {
+            send(subject, headers, payload, ack, error);
+            return;
+        }
+
+        Publish publish{subject.toByteArray(), headers, payload.toByteArray(), ack, error};
+        publish.headers.detach();
+
+        m_queue.enqueue(std::move(publish));
+    }
+
+    inline int JetStream::pendingAcks() const
+    {
+        return m_in_flight + int(m_queue.size());
+    }
+
+    inline void JetStream::publishAsyncComplete(FlushCallback callback)
+    {
+        if(!callback)
+            return;
+
+        if(pendingAcks() == 0)
+        {
+            callback();
+            return;
+        }
+
+        m_complete_callbacks.append(callback);
+    }
+
+    // {"stream":"ORDERS","seq":42,"duplicate":false} or {"error":{"code":400,"err_code":10060,"description":"..."}}
+    inline bool JetStream::parsePubAck(const QByteArray &payload, PubAck &ack, QString &error)
+    {
+        QJsonParseError parse_error;
+        const QJsonObject json = QJsonDocument::fromJson(payload, &parse_error).object();
+
+        if(parse_error.error != QJsonParseError::NoError)
+        {
+            error = QStringLiteral("invalid acknowledgement: ") + parse_error.errorString();
+            return false;
+        }
+
+        if(json.contains(QStringLiteral("error")))
+        {
+            const QJsonObject api_error = json.value(QStringLiteral("error")).toObject();
+            error = api_error.value(QStringLiteral("description")).toString();
+
+            if(error.isEmpty())
+                error = QStringLiteral("api error %1").arg(api_error.value(QStringLiteral("code")).toInt());
+
+            return false;
+        }
+
+        ack.stream = json.value(QStringLiteral("stream")).toString().toUtf8();
+        ack.sequence = uint64_t(json.value(QStringLiteral("seq")).toInteger());
+        ack.duplicate = json.value(QStringLiteral("duplicate")).toBool();
+        ack.domain = json.value(QStringLiteral("domain")).toString().toUtf8();
+
+        if(ack.stream.isEmpty())
+        {
+            error = QStringLiteral("invalid acknowledgement: missing stream");
+            return false;
+        }
+
+        return true;
+    }
+
+    inline void JetStream::send(QByteArrayView subject, const Headers &headers, QByteArrayView payload, PubAckCallback ack, ErrorCallback error)
+    {
+        if(!m_client)
+        {
+            if(error)
+                error(QStringLiteral("client destroyed"));
+            return;
+        }
+
+        m_in_flight++;
+
+        // client may outlive context, callbacks check for that
+        QPointer<JetStream> self(this);
+
+        m_client->request(subject, headers, payload, [self, ack, error](const Message &reply)
+        {
+            PubAck result;
+            QString message;
+            const bool valid = JetStream::parsePubAck(reply.payload, result, message);
+
+            if(valid && ack)
+                ack(result);
+            else if(!valid && error)
+                error(message);
+
+            if(self)
+                self->complete();
+        },
+        m_options.timeout, [self, error](const QString &message)
+        {
+            if(error)
+                error(message);
+
+            if(self)
+                self->complete();
+        });
+    }
+
+    inline PullConsumer *JetStream::pullSubscribe(QByteArrayView stream, QByteArrayView consumer, MessageHandler handler, const PullOptions &options)
+    {
+        QByteArray subject;
+        subject.reserve(m_options.api_prefix.size() + stream.size() + consumer.size() + 22);
+        subject.append(m_options.api_prefix);
+        subject.append(".CONSUMER.MSG.NEXT.", 19);
+        subject.append(stream.data(), stream.size());
+        subject.append('.');
+        subject.append(consumer.data(), consumer.size());
+
+        auto pull = new PullConsumer(m_client, subject, handler, options, this);
+        pull->start();
+
+        return pull;
+    }
+
+    inline void JetStream::ack(const Message &message)
+    {
+        if(m_client && !message.reply.isEmpty())
+            m_client->publishBytes(message.reply, "+ACK");
+    }
+
+    inline void JetStream::nak(const Message &message)
+    {
+        if(m_client && !message.reply.isEmpty())
+            m_client->publishBytes(message.reply, "-NAK");
+    }
+
+    inline void JetStream::term(const Message &message)
+    {
+        if(m_client && !message.reply.isEmpty())
+            m_client->publishBytes(message.reply, "+TERM");
+    }
+
+    inline void JetStream::inProgress(const Message &message)
+    {
+        if(m_client && !message.reply.isEmpty())
+            m_client->publishBytes(message.reply, "+WPI");
+    }
+
+    inline void JetStream::complete()
+    {
+        m_in_flight--;
+
+        // outer call keeps sending, no recursion for each rejected publish
+        if(m_completing)
+            return;
+
+        m_completing = true;
+
+        // error callback of rejected publish can destroy the context
+        QPointer<JetStream> self(this);
+
+        while((m_options.max_pending < 0 || m_in_flight < m_options.max_pending) && !m_queue.isEmpty())
+        {
+            Publish publish = m_queue.dequeue();
+            send(publish.subject, publish.headers, publish.payload, std::move(publish.ack), std::move(publish.error));
+
+            if(!self)
+                return;
+        }
+
+        m_completing = false;
+
+        if(pendingAcks() > 0 || m_complete_callbacks.isEmpty())
+            return;
+
+        const QList<FlushCallback> callbacks = std::exchange(m_complete_callbacks, {});
+        for(const FlushCallback &callback : callbacks)
+            callback();
+    }
+
+    inline PullConsumer::PullConsumer(Client *client, const QByteArray &subject, MessageHandler handler, const PullOptions &options, QObject *parent) :
+        QObject(parent),
+        m_client(client),
+        m_subject(subject),
+        m_handler(handler),
+        m_options(options)
+    {
+        // fetch without expiry lost with connection would never be replaced
+        if(m_options.expires <= 0)
+        {
+            qWarning() << "pull consumer expires must be positive, using" << PullOptions().expires;
+            m_options.expires = PullOptions().expires;
+        }
+
+        // {"batch":100,"max_bytes":0,"expires":30000000000}, expiration is in nanoseconds
+        m_request.append("{\"batch\":", 9);
+        append_number(m_request, uint64_t(qMax(1, m_options.batch)));
+
+        if(m_options.max_bytes > 0)
+        {
+            m_request.append(",\"max_bytes\":", 13);
+            append_number(m_request, uint64_t(m_options.max_bytes));
+        }
 
-    //! main callback message
-    using MessageCallback = std::function<void(QString &&message, QString &&inbox, QString &&subject)>;
-    using ConnectCallback = std::function<void()>;
+        m_request.append(",\"expires\":", 11);
+        append_number(m_request, uint64_t(m_options.expires) * 1000000);
 
-    //!
-    //! \brief The Options struct
-    //! holds all client options
-    struct Options
+        m_request.append('}');
+
+        QObject::connect(&m_expired_timer, &QTimer::timeout, this, [this]
+        {
+            process_expired();
+        });
+
+        // fetches sent before connection was lost may be gone, don't wait for them to expire
+        QObject::connect(client, &Client::reconnected, this, [this]
+        {
+            m_fetches.clear();
+            fetch();
+        });
+    }
+
+    inline void PullConsumer::start()
     {
-        bool verbose = false;
-        bool pedantic = false;
-        bool ssl_required = false;
-        bool ssl = false;
-        bool ssl_verify = true;
-        QString ssl_key;
-        QString ssl_cert;
-        QString ssl_ca;
-        QString name = "qt-nats";
-        const QString lang = "cpp";
-        const QString version = "1.0.0";
-        QString user;
-        QString pass;
-        QString token;
-    };
+        if(!m_client)
+            return;
 
-    //!
-    //! \brief The Subscription class
-    //! holds subscription data and emits signal when ready as alternative to callbacks
-    class Subscription : public QObject
+        m_inbox = m_client->newInbox() + '.';
+        m_ssid = m_client->subscribe(QString::fromLatin1(m_inbox + '*'), [this](const Message &message)
+        {
+            process_message(message);
+        });
+
+        m_clock.start();
+        m_expired_timer.start(m_options.expires);
+
+        fetch();
+    }
+
+    inline void PullConsumer::stop()
     {
-        Q_OBJECT
+        if(m_ssid == 0)
+            return;
 
-    public:
-        explicit Subscription(QObject *parent = nullptr): QObject(parent) {}
+        if(m_client)
+            m_client->unsubscribe(m_ssid);
 
-        QString subject;
-        QString message;
-        QString inbox;
-        uint64_t ssid = 0;
+        m_ssid = 0;
+        m_fetches.clear();
+        m_expired_timer.stop();
+    }
 
-    signals:
+    inline bool PullConsumer::isActive() const
+    {
+        return m_ssid != 0;
+    }
 
-        void received();
-    };
+    inline uint64_t PullConsumer::delivered() const
+    {
+        return m_delivered;
+    }
+
+    // PUB <prefix>.CONSUMER.MSG.NEXT.<stream>.<consumer> <inbox>.<token> <request>
+    inline void PullConsumer::fetch()
+    {
+        if(!m_client || m_ssid == 0)
+            return;
+
+        QByteArray reply;
+        reply.reserve(m_inbox.size() + 20);
+
+        while(m_fetches.size() < qMax(1, m_options.prefetch))
+        {
+            const uint64_t token = ++m_token;
+
+            reply.truncate(0);
+            reply.append(m_inbox);
+            append_number(reply, token);
+
+            m_fetches.enqueue(Fetch{token, qMax(1, m_options.batch), m_options.max_bytes, m_clock.elapsed()});
+            m_client->publishBytes(m_subject, m_request, reply);
+        }
+    }
+
+    inline void PullConsumer::process_message(const Message &message)
+    {
+        // stored messages keep their subject, only status messages come on fetch inbox
+        if(!message.headers.isEmpty() && message.payload.isEmpty() && message.subject.startsWith(m_inbox))
+        {
+            const int status = message.headers.status();
+            if(status > 0)
+            {
+                process_status(message, status);
+                return;
+            }
+        }
+
+        if(!m_fetches.isEmpty())
+        {
+            Fetch &fetch = m_fetches.head();
+            fetch.remaining--;
+            fetch.remaining_bytes -= message.payload.size();
+
+            if(fetch.remaining <= 0 || (m_options.max_bytes > 0 && fetch.remaining_bytes <= 0))
+                m_fetches.dequeue();
+        }
+
+        m_delivered++;
+
+        // handler may stop consumer
+        const QPointer<PullConsumer> self(this);
+
+        if(m_handler)
+            m_handler(message);
+
+        if(self)
+            fetch();
+    }
+
+    // 404 no messages, 408 request expired, 409 fetch or consumer limits, 100 idle heartbeat
+    inline void PullConsumer::process_status(const Message &message, int status)
+    {
+        if(status == 100)
+            return;
+
+        const int64_t token = Parser::parse_uint(QByteArrayView(message.subject).sliced(m_inbox.size()));
+
+        m_fetches.removeIf([token](const Fetch &fetch)
+        {
+            return int64_t(fetch.token) == token;
+        });
+
+        if(status == 409)
+        {
+            const QByteArray description = message.headers.description();
+
+            // fetch was closed by limits or leadership change, anything else stops consumer
+            if(!description.startsWith("Message Size Exceeds MaxBytes") && !description.startsWith("Leadership Change")
+                    && !description.startsWith("Exceeded MaxWaiting"))
+            {
+                qWarning() << "pull consumer stopped:" << description;
+
+                stop();
+                emit error(QString::fromUtf8(description));
+                return;
+            }
+        }
+        else if(status != 404 && status != 408)
+        {
+            qWarning() << "pull consumer status:" << status << message.headers.description();
+        }
+
+        fetch();
+    }
+
+    inline void PullConsumer::process_expired()
+    {
+        // server answers expired fetch with 408, give it some time before giving up on it
+        const qint64 deadline = m_clock.elapsed() - m_options.expires - 5000;
+        const qsizetype count = m_fetches.size();
+
+        m_fetches.removeIf([deadline](const Fetch &fetch)
+        {
+            return fetch.sent < deadline;
+        });
+
+        if(m_fetches.size() != count)
+            fetch();
+    }
 
     //!
-    //! \brief The Client class
-    //! main client class
-    class Client : public QObject
+    //! \brief The ClientPool class
+    //! spreads load over several connections, each client lives on its own I/O thread
+    //! publishes and requests go to connection picked by subject hash so messages on one subject stay ordered,
+    //! subscriptions are assigned round-robin
+    //! callbacks run on the thread of connection that received the message
+    //! covers publish, subscribe and request, everything else is available per connection through client()
+    class ClientPool : public QObject
     {
         Q_OBJECT
     public:
-        explicit Client(QObject *parent = nullptr);
+        explicit ClientPool(int connections = QThread::idealThreadCount(), QObject *parent = nullptr);
+        ~ClientPool();
 
         //!
-        //! \brief publish
-        //! \param subject
-        //! \param message
-        //! publish given message with subject
-        void publish(const QString &subject, const QString &message, const QString &inbox);
-        void publish(const QString &subject, const QString &message = "");
+        //! \brief size
+        //! \return number of connections
+        int size() const;
 
         //!
-        //! \brief subscribe
-        //! \param subject
-        //! \param callback
-        //! \return subscription id
-        //! subscribe to given subject
-        //! when message is received, callback is fired
-        uint64_t subscribe(const QString &subject, Nats::MessageCallback callback);
+        //! \brief client
+        //! \return connection, lives on its own thread
+        Client *client(int index) const;
 
         //!
-        //! \brief subscribe
-        //! \param subject
-        //! \param queue
-        //! \param callback
-        //! \return subscription id
-        //! overloaded function
-        //! subscribe to given subject and queue
-        //! when message is received, callback is fired
-        //! each message will be delivered to only one subscriber per queue group
-        uint64_t subscribe(const QString &subject, const QString &queue, Nats::MessageCallback callback);
+        //! \brief isConnected
+        //! \return true when all connections are established
+        bool isConnected() const;
 
         //!
-        //! \brief subscribe
-        //! \param subject
-        //! \return
-        //! return subscription class holding result for signal/slot version
-        Subscription *subscribe(const QString &subject);
+        //! \brief publish
+        //! thread-safe, same subject always goes through the same connection
+        void publish(const QString &subject, const QString &message = "");
+        bool publishBytes(QByteArrayView subject, QByteArrayView payload, QByteArrayView reply = {});
+        bool publishBytes(QByteArrayView subject, const Nats::Headers &headers, QByteArrayView payload, QByteArrayView reply = {});
 
         //!
-        //! \brief unsubscribe
-        //! \param ssid
-        //! \param max_messages
-        //!
+        //! \brief subscribe
+        //! \return pool subscription id
+        //! subscription is made on next connection by its thread, call never waits for it
+        //! so callbacks on connection threads can subscribe freely
+        uint64_t subscribe(const QString &subject, Nats::MessageHandler handler);
+        uint64_t subscribe(const QString &subject, const QString &queue, Nats::MessageHandler handler);
+
         void unsubscribe(uint64_t ssid, int max_messages = 0);
 
         //!
         //! \brief request
-        //! \param subject
-        //! \param message
-        //! \return
-        //! make request using given subject and optional message
-        uint64_t request(const QString subject, const QString message, Nats::MessageCallback callback);
-        uint64_t request(const QString subject, Nats::MessageCallback callback);
+        //! handler and error callback run on thread of connection picked for subject
+        void request(QByteArrayView subject, QByteArrayView payload, Nats::MessageHandler handler, int timeout = 0, Nats::ErrorCallback error = nullptr);
+
+        //!
+        //! \brief statistics
+        //! \return counters and latency histograms summed over all connections
+        //! subscription entries are left out, client(index)->statistics() on connection thread has them
+        Nats::Statistics statistics() const;
 
     signals:
 
         //!
         //! \brief connected
-        //! signal that the client is connected
+        //! all connections are established, again after any of them was restored
         void connected();
 
-        //!
-        //! \brief connected
-        //! signal that the client is connected
-        void error(const QString);
-
         //!
         //! \brief disconnected
-        //! signal that the client is disconnected
+        //! one of the connections was lost
         void disconnected();
 
+        //!
+        //! \brief error
+        //! error reported by any connection
+        void error(const QString);
+
     public slots:
 
-        //!
-        //! \brief connect
-        //! \param host
-        //! \param port
-        //! connect to server with given host and port options
-        //! after valid connection is established 'connected' signal is emmited
         void connect(const QString &host = "127.0.0.1", quint16 port = 4222, Nats::ConnectCallback callback = nullptr);
         void connect(const QString &host, quint16 port, const Nats::Options &options, Nats::ConnectCallback callback = nullptr);
 
-        //!
-        //! \brief disconnect
-        //! disconnect from server by closing socket
         void disconnect();
 
-        //!
-        //! \brief connectSync
-        //! \param host
-        //! \param port
-        //! synchronous version of connect, waits until connections with nats server is valid
-        //! this will still fire 'connected' signal if one wants to use that instead
-        bool connectSync(const QString &host = "127.0.0.1", quint16 port = 4222);
-        bool connectSync(const QString &host, quint16 port, const Nats::Options &options);
-
     private:
 
         //!
-        //! \brief debug_mode
-        //! extra debug output, can be set with enviroment variable DEBUG=qt-nats
-        bool _debug_mode = false;
+        //! \brief run
+        //! run function on client thread and wait for it, directly when already there, only used on teardown
+        template<typename Function>
+        void run(Client *client, Function &&function);
 
         //!
-        //! \brief CLRF
-        //! NATS protocol separator
-        const QByteArray CLRF = "\r\n";
+        //! \brief client_for
+        //! \return connection index for subject
+        int client_for(QByteArrayView subject) const;
+
+        void process_connected();
+        void process_disconnected();
 
         //!
-        //! \brief m_buffer
-        //! main buffer that holds data from server
-        QByteArray m_buffer;
+        //! \brief m_clients
+        QList<Client *> m_clients;
 
         //!
-        //! \brief m_ssid
-        //! subscribtion id holder
-        uint64_t m_ssid = 0;
+        //! \brief m_threads
+        //! one I/O thread per client
+        QList<QThread *> m_threads;
 
         //!
-        //! \brief m_socket
-        //! main tcp socket
-        QSslSocket m_socket;
+        //! \brief m_next
+        //! last pool subscription id, ids are assigned to connections round-robin
+        std::atomic<uint64_t> m_next{0};
 
         //!
-        //! \brief m_options
-        //! client options
-        Options m_options;
+        //! \brief m_ssids
+        //! client ssids by pool subscription id, one table per connection used only on its thread
+        QList<std::shared_ptr<QHash<uint64_t, uint64_t>>> m_ssids;
+
+        //!
+        //! \brief m_connected
+        //! established connections, updated on pool thread
+        int m_connected = 0;
+        bool m_all_connected = false;
+
+        ConnectCallback m_connect_callback;
+    };
+
+    inline ClientPool::ClientPool(int connections, QObject *parent) : QObject(parent)
+    {
+        for(int i = 0; i < qMax(1, connections); i++)
+        {
+            auto thread = new QThread;
+            thread->setObjectName(QStringLiteral("nats-%1").arg(i));
+
+            auto client = new Client;
+            client->moveToThread(thread);
+
+            // signals arrive queued on pool thread
+            QObject::connect(client, &Client::connected, this, &ClientPool::process_connected);
+            QObject::connect(client, &Client::reconnected, this, &ClientPool::process_connected);
+            QObject::connect(client, &Client::disconnected, this, &ClientPool::process_disconnected);
+            QObject::connect(client, &Client::error, this, &ClientPool::error);
+
+            thread->start();
+
+            m_clients.append(client);
+            m_threads.append(thread);
+        }
+
+        for(int i = 0; i < m_clients.size(); i++)
+            m_ssids.append(std::make_shared<QHash<uint64_t, uint64_t>>());
+    }
+
+    inline ClientPool::~ClientPool()
+    {
+        for(int i = 0; i < m_clients.size(); i++)
+        {
+            Client *client = m_clients.at(i);
+
+            // client has to be closed and deleted on its own thread
+            QObject::disconnect(client, nullptr, this, nullptr);
+            run(client, [client]
+            {
+                client->disconnect();
+                delete client;
+            });
+
+            m_threads.at(i)->quit();
+            m_threads.at(i)->wait();
+            delete m_threads.at(i);
+        }
+    }
+
+    inline int ClientPool::size() const
+    {
+        return m_clients.size();
+    }
+
+    inline Client *ClientPool::client(int index) const
+    {
+        return m_clients.at(index);
+    }
+
+    inline bool ClientPool::isConnected() const
+    {
+        return m_all_connected;
+    }
+
+    template<typename Function>
+    inline void ClientPool::run(Client *client, Function &&function)
+    {
+        if(QThread::currentThread() == client->thread())
+            function();
+        else
+            QMetaObject::invokeMethod(client, std::forward<Function>(function), Qt::BlockingQueuedConnection);
+    }
+
+    inline int ClientPool::client_for(QByteArrayView subject) const
+    {
+        return int(qHash(subject, 0) % size_t(m_clients.size()));
+    }
+
+    inline void ClientPool::connect(const QString &host, quint16 port, ConnectCallback callback)
+    {
+        connect(host, port, Options(), callback);
+    }
+
+    inline void ClientPool::connect(const QString &host, quint16 port, const Options &options, ConnectCallback callback)
+    {
+        m_connect_callback = callback;
+
+        for(Client *client : std::as_const(m_clients))
+        {
+            QMetaObject::invokeMethod(client, [client, host, port, options]
+            {
+                client->connect(host, port, options);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    inline void ClientPool::disconnect()
+    {
+        for(Client *client : std::as_const(m_clients))
+        {
+            QMetaObject::invokeMethod(client, [client]
+            {
+                client->disconnect();
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    inline void ClientPool::process_connected()
+    {
+        m_connected++;
+
+        if(m_connected < m_clients.size() || m_all_connected)
+            return;
+
+        m_all_connected = true;
+
+        // callback only for the first time, like Client does
+        if(m_connect_callback)
+        {
+            ConnectCallback callback = std::move(m_connect_callback);
+            m_connect_callback = nullptr;
+            callback();
+        }
+
+        emit connected();
+    }
 
-        //!
-        //! \brief m_callbacks
-        //! subscription callbacks
-        QHash<uint64_t, MessageCallback> m_callbacks;
+    inline void ClientPool::process_disconnected()
+    {
+        m_connected = qMax(0, m_connected - 1);
 
-        //!
-        //! \brief send_info
-        //! \param options
-        //! send client information and options to server
-        void send_info(const Options &options);
+        if(!m_all_connected)
+            return;
 
-        //!
-        //! \brief parse_info
-        //! \param message
-        //! \return
-        //! parse INFO message from server and return json object with data
-        QJsonObject parse_info(const QByteArray &message);
+        m_all_connected = false;
 
-        //!
-        //! \brief set_listeners
-        //! set connection listeners
-        void set_listeners();
+        emit disconnected();
+    }
 
-        //!
-        //! \brief process_inboud
-        //! \param buffer
-        //! process messages from buffer
-        bool process_inboud(const QByteArray &buffer);
-    };
+    inline void ClientPool::publish(const QString &subject, const QString &message)
+    {
+        const QByteArray bytes = subject.toUtf8();
+        m_clients.at(client_for(bytes))->publishBytes(bytes, message.toUtf8());
+    }
 
-    inline Client::Client(QObject *parent) : QObject(parent)
+    inline bool ClientPool::publishBytes(QByteArrayView subject, QByteArrayView payload, QByteArrayView reply)
     {
-        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-        _debug_mode = (env.value(QStringLiteral("DEBUG")).indexOf("qt-nats") != -1);
+        return m_clients.at(client_for(subject))->publishBytes(subject, payload, reply);
+    }
 
-        if(_debug_mode)
-            DEBUG("debug mode");
+    inline bool ClientPool::publishBytes(QByteArrayView subject, const Headers &headers, QByteArrayView payload, QByteArrayView reply)
+    {
+        return m_clients.at(client_for(subject))->publishBytes(subject, headers, payload, reply);
     }
 
-    inline void Client::connect(const QString &host, quint16 port, ConnectCallback callback)
+    inline uint64_t ClientPool::subscribe(const QString &subject, MessageHandler handler)
     {
-        connect(host, port, m_options, callback);
+        return subscribe(subject, QString(), std::move(handler));
     }
 
-    inline void Client::connect(const QString &host, quint16 port, const Options &options, ConnectCallback callback)
+    // pool subscription id - 1 keeps connection index in its remainder, queued calls of one connection
+    // run in order so unsubscribe always finds its subscription
+    inline uint64_t ClientPool::subscribe(const QString &subject, const QString &queue, MessageHandler handler)
     {
-        // Check is client socket is already connected and return if it is
-        if (m_socket.isOpen())
-            return;
+        const uint64_t id = m_next.fetch_add(1, std::memory_order_relaxed) + 1;
+        const int index = int((id - 1) % uint64_t(m_clients.size()));
+        Client *client = m_clients.at(index);
 
-        QObject::connect(&m_socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError socketError)
+        QMetaObject::invokeMethod(client, [client, ssids = m_ssids.at(index), id, subject, queue, handler = std::move(handler)]
         {
-            DEBUG(socketError);
+            ssids->insert(id, client->subscribe(subject, queue, handler));
+        }, Qt::QueuedConnection);
 
-            emit error(m_socket.errorString());
-        });
+        return id;
+    }
 
-        QObject::connect(&m_socket, static_cast<void(QSslSocket::*)(const QList<QSslError> &)>(&QSslSocket::sslErrors),this, [this](const QList<QSslError> &errors)
-        {
-            DEBUG(errors);
+    inline void ClientPool::unsubscribe(uint64_t ssid, int max_messages)
+    {
+        if(ssid == 0)
+            return;
 
-            emit error(m_socket.errorString());
-        });
+        const int index = int((ssid - 1) % uint64_t(m_clients.size()));
+        Client *client = m_clients.at(index);
 
-        QObject::connect(&m_socket, &QSslSocket::encrypted, this, [this, options, callback]
+        QMetaObject::invokeMethod(client, [client, ssids = m_ssids.at(index), ssid, max_messages]
         {
-            DEBUG("SSL/TLS successful");
+            const uint64_t client_ssid = ssids->value(ssid);
+            if(client_ssid == 0)
+                return;
 
-            send_info(options);
-            set_listeners();
+            client->unsubscribe(client_ssid, max_messages);
 
-            if(callback)
-                callback();
+            if(max_messages <= 0)
+                ssids->remove(ssid);
+        }, Qt::QueuedConnection);
+    }
 
-            emit connected();
-        });
+    inline void ClientPool::request(QByteArrayView subject, QByteArrayView payload, MessageHandler handler, int timeout, ErrorCallback error)
+    {
+        Client *client = m_clients.at(client_for(subject));
 
-        QObject::connect(&m_socket, &QSslSocket::disconnected, this, [this]()
+        if(QThread::currentThread() == client->thread())
         {
-            DEBUG("socket disconnected");
-            emit disconnected();
-
-            // Disconnect everything connected to an m_socket's signals
-            QObject::disconnect(&m_socket, nullptr, nullptr, nullptr);
-        });
+            client->request(subject, payload, std::move(handler), timeout, std::move(error));
+            return;
+        }
 
-        // receive first info message and disconnect
-        auto signal = std::make_shared<QMetaObject::Connection>();
-        *signal = QObject::connect(&m_socket, &QSslSocket::readyRead, this, [this, signal, options, callback]
+        // no need to wait, views are copied for the client thread
+        QMetaObject::invokeMethod(client, [client, subject = subject.toByteArray(), payload = payload.toByteArray(), handler = std::move(handler), timeout, error = std::move(error)]
         {
-            QObject::disconnect(*signal);
-            QByteArray info_message = m_socket.readAll();
+            client->request(subject, payload, handler, timeout, error);
+        }, Qt::QueuedConnection);
+    }
 
-            QJsonObject json = parse_info(info_message);
-            bool ssl_required = json.value(QStringLiteral("ssl_required")).toBool();
+    inline Statistics ClientPool::statistics() const
+    {
+        Statistics total;
 
-            // if client or server wants ssl start encryption
-            if(options.ssl || options.ssl_required || ssl_required)
-            {
-                DEBUG("starting SSL/TLS encryption");
+        for(const Client *client : m_clients)
+        {
+            const Statistics statistics = client->statistics();
+
+            total.in_msgs += statistics.in_msgs;
+            total.in_bytes += statistics.in_bytes;
+            total.out_msgs += statistics.out_msgs;
+            total.out_bytes += statistics.out_bytes;
+            total.reconnects += statistics.reconnects;
+            total.parse_errors += statistics.parse_errors;
+            total.max_buffered_bytes = qMax(total.max_buffered_bytes, statistics.max_buffered_bytes);
+
+            total.request_latency.merge(statistics.request_latency);
+            total.callback_latency.merge(statistics.callback_latency);
+        }
 
-                if(!options.ssl_verify)
-                    m_socket.setPeerVerifyMode(QSslSocket::VerifyNone);
+        return total;
+    }
 
-                if(!options.ssl_ca.isEmpty())
-                {
-                    QSslConfiguration config = m_socket.sslConfiguration();
-                    config.setCaCertificates(QSslCertificate::fromPath(options.ssl_ca));
-                }
+#ifdef QT_NATS_COROUTINES
+
+    //!
+    //! \brief The Task struct
+    //! fire-and-forget coroutine, starts right away and frees its frame when it returns
+    //! lets code on client thread await connections, requests and messages in straight line
+    struct Task
+    {
+        struct promise_type
+        {
+            Task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
 
-                if(!options.ssl_key.isEmpty())
-                    m_socket.setPrivateKey(options.ssl_key);
+    //!
+    //! \brief The ConnectAwaitable class
+    //! result of Client::connectAsync, resumes with true once connected or false when connection attempt
+    //! is over, errors the handshake recovers from are not fatal
+    class ConnectAwaitable
+    {
+    public:
+        ConnectAwaitable(Client *client, const QString &host, quint16 port, const Options &options);
 
-                if(!options.ssl_cert.isEmpty())
-                    m_socket.setLocalCertificate(options.ssl_cert);
+        ConnectAwaitable(const ConnectAwaitable &) = delete;
+        ConnectAwaitable &operator=(const ConnectAwaitable &) = delete;
 
-                m_socket.startClientEncryption();
-            }
-            else
-            {
-                send_info(options);
-                set_listeners();
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const noexcept { return m_connected; }
 
-                if(callback)
-                    callback();
+    private:
 
-                emit connected();
-            }
-        });
+        void finish(bool connected);
 
+        Client *m_client;
+        QString m_host;
+        quint16 m_port;
+        Options m_options;
 
-        DEBUG("connect started" << host << port);
+        std::coroutine_handle<> m_handle;
 
-        m_socket.connectToHost(host, port);
-    }
+        //!
+        //! \brief m_context
+        //! receiver of client signals and deferred checks, they go away with the awaitable
+        QObject m_context;
+        bool m_connected = false;
+    };
 
-    inline void Client::disconnect()
+    //!
+    //! \brief The Reply struct
+    //! result of awaited request
+    struct Reply
     {
-        m_socket.flush();
-        m_socket.close();
-    }
+        //! detached, can be kept
+        Message message;
 
-    inline bool Client::connectSync(const QString &host, quint16 port)
-    {
-        return connectSync(host, port, m_options);
-    }
+        //! 'request timeout', 'no responders', 'connection lost' or 'connection closed', empty on success
+        QString error;
 
-    inline bool Client::connectSync(const QString &host, quint16 port, const Options &options)
+        bool isValid() const { return error.isEmpty(); }
+    };
+
+    //!
+    //! \brief The RequestAwaitable class
+    //! result of Client::requestAsync, request is sent when awaited, subject and payload are copied
+    //! so the awaitable can be kept, callbacks only capture the awaiting frame
+    //! timeout must be set, otherwise awaiting resumes right away with an error
+    class RequestAwaitable
     {
-         QObject::connect(&m_socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError socketError)
+    public:
+        RequestAwaitable(Client *client, QByteArrayView subject, const Headers &headers, QByteArrayView payload, int timeout);
 
-        {
-            DEBUG(socketError);
+        bool await_ready() const noexcept { return m_timeout <= 0; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        Reply await_resume() { return std::move(m_reply); }
 
-            emit error(m_socket.errorString());
-        });
+    private:
 
-        m_socket.connectToHost(host, port);
-        if(!m_socket.waitForConnected())
-            return false;
+        Client *m_client;
+        QByteArray m_subject;
+        Headers m_headers;
+        QByteArray m_payload;
+        int m_timeout;
 
-        if(!m_socket.waitForReadyRead())
-            return false;
+        std::coroutine_handle<> m_handle;
+        Reply m_reply;
+    };
 
-        // receive first info message
-        auto info_message = m_socket.readAll();
+    //!
+    //! \brief The MessageStream class
+    //! subscription read by awaiting next(), ends with std::nullopt once closed
+    //! at most capacity messages wait for the reader, newer ones are dropped and counted
+    //! must be used from client thread
+    class MessageStream
+    {
+    public:
+        MessageStream(Client *client, const QString &subject, const QString &queue = QString(), int capacity = 1024);
+        ~MessageStream();
 
-        QJsonObject json = parse_info(info_message);
-        bool ssl_required = json.value(QStringLiteral("ssl_required")).toBool();
+        MessageStream(const MessageStream &) = delete;
+        MessageStream &operator=(const MessageStream &) = delete;
 
-        // if client or server wants ssl start encryption
-        if(options.ssl || options.ssl_required || ssl_required)
+        class NextAwaitable
         {
-            DEBUG("starting SSL/TLS encryption");
+        public:
+            explicit NextAwaitable(MessageStream *stream) : m_stream(stream) {}
 
-            if(!options.ssl_verify)
-                m_socket.setPeerVerifyMode(QSslSocket::VerifyNone);
-
-            if(!options.ssl_ca.isEmpty())
-            {
-                QSslConfiguration config = m_socket.sslConfiguration();
-                config.setCaCertificates(QSslCertificate::fromPath(options.ssl_ca));
-            }
+            bool await_ready() const noexcept { return !m_stream->m_buffer.isEmpty() || m_stream->m_closed; }
+            void await_suspend(std::coroutine_handle<> handle) { m_stream->m_waiting = handle; }
+            std::optional<Message> await_resume();
 
-            if(!options.ssl_key.isEmpty())
-                m_socket.setPrivateKey(options.ssl_key);
+        private:
+            MessageStream *m_stream;
+        };
 
-            if(!options.ssl_cert.isEmpty())
-                m_socket.setLocalCertificate(options.ssl_cert);
+        //!
+        //! \brief next
+        //! \return awaitable resuming with next message, std::nullopt when stream is closed
+        NextAwaitable next() { return NextAwaitable(this); }
 
-            m_socket.startClientEncryption();
+        //!
+        //! \brief close
+        //! unsubscribe, buffered messages can still be read
+        void close();
 
-            if(!m_socket.waitForEncrypted())
-                return false;
-        }
+        bool isClosed() const { return m_closed; }
 
-        send_info(options);
-        set_listeners();
+        //!
+        //! \brief dropped
+        //! \return messages dropped because buffer was full
+        uint64_t dropped() const { return m_dropped; }
 
-        emit connected();
+    private:
 
-        return true;
-    }
+        void process_message(const Message &message);
 
-    inline void Client::send_info(const Options &options)
-    {
-        QString message =
-                QString("CONNECT {")
-                % "\"verbose\":" % (options.verbose ? "true" : "false") % ","
-                % "\"pedantic\":" % (options.pedantic ? "true" : "false") % ","
-                % "\"ssl_required\":" % (options.ssl_required ? "true" : "false") % ","
-                % "\"name\":" % "\"" % options.name % "\","
-                % "\"lang\":" % "\"" %options.lang % "\","
-                % "\"user\":" % "\"" % options.user % "\","
-                % "\"pass\":" % "\"" % options.pass % "\","
-                % "\"auth_token\":" % "\"" % options.token % "\""
-                % "} " % CLRF;
+        //!
+        //! \brief m_client
+        QPointer<Client> m_client;
+        uint64_t m_ssid = 0;
 
-        DEBUG("send info message:" << message);
+        //!
+        //! \brief m_buffer
+        //! detached messages waiting for reader
+        QQueue<Message> m_buffer;
+        int m_capacity;
+        uint64_t m_dropped = 0;
 
-        m_socket.write(message.toUtf8());
-    }
+        //!
+        //! \brief m_waiting
+        //! reader suspended in next()
+        std::coroutine_handle<> m_waiting;
+        bool m_closed = false;
+    };
 
-    inline QJsonObject Client::parse_info(const QByteArray &message)
+    inline ConnectAwaitable Client::connectAsync(const QString &host, quint16 port)
     {
-        DEBUG(message);
-
-        // discard 'INFO '
-        return QJsonDocument::fromJson(message.mid(5)).object();
+        return ConnectAwaitable(this, host, port, m_options);
     }
 
-    inline void Client::publish(const QString &subject, const QString &message)
+    inline ConnectAwaitable Client::connectAsync(const QString &host, quint16 port, const Options &options)
     {
-        publish(subject, message, "");
+        return ConnectAwaitable(this, host, port, options);
     }
 
-    inline void Client::publish(const QString &subject, const QString &message, const QString &inbox)
+    inline RequestAwaitable Client::requestAsync(QByteArrayView subject, QByteArrayView payload, int timeout)
     {
-        QString body = QStringLiteral("PUB ") % subject % " " % inbox % (inbox.isEmpty() ? "" : " ") % QString::number(message.toUtf8().length()) % CLRF % message % CLRF;
-
-        DEBUG("published:" << body);
-
-        m_socket.write(body.toUtf8());
+        return RequestAwaitable(this, subject, Headers(), payload, timeout);
     }
 
-    inline uint64_t Client::subscribe(const QString &subject, MessageCallback callback)
+    inline RequestAwaitable Client::requestAsync(QByteArrayView subject, const Headers &headers, QByteArrayView payload, int timeout)
     {
-        return subscribe(subject, "", callback);
+        return RequestAwaitable(this, subject, headers, payload, timeout);
     }
 
-    inline uint64_t Client::subscribe(const QString &subject, const QString &queue, MessageCallback callback)
+    inline ConnectAwaitable::ConnectAwaitable(Client *client, const QString &host, quint16 port, const Options &options) :
+        m_client(client),
+        m_host(host),
+        m_port(port),
+        m_options(options)
     {
-        m_callbacks[++m_ssid] = callback;
-
-        QString message = QStringLiteral("SUB ") % subject % " " % queue % (queue.isEmpty() ? "" : " ") % QString::number(m_ssid) % CLRF;
-
-        m_socket.write(message.toUtf8());
-
-        DEBUG("subscribed:" << message);
-
-        return m_ssid;
     }
 
-    inline Subscription *Client::subscribe(const QString &subject)
+    inline bool ConnectAwaitable::await_suspend(std::coroutine_handle<> handle)
     {
-        auto subscription = new Subscription;
+        // connect would be ignored and nothing would resume us
+        if(m_client->m_socket.isOpen() || m_client->m_reconnecting)
+        {
+            m_connected = m_client->m_connected;
+            return false;
+        }
+
+        m_handle = handle;
 
-        subscription->ssid = subscribe(subject, "", [subscription](const QString &message, const QString &inbox, const QString &subject)
+        QObject::connect(m_client, &Client::connected, &m_context, [this]
         {
-            subscription->message = message;
-            subscription->subject = subject;
-            subscription->inbox = inbox;
+            finish(true);
+        });
 
-            emit subscription->received();
+        QObject::connect(m_client, &Client::error, &m_context, [this]
+        {
+            // socket error closes the socket right after, SSL errors may still be ignored, connect timeout aborts
+            QMetaObject::invokeMethod(&m_context, [this]
+            {
+                if(m_handle && m_client->m_socket.state() == QAbstractSocket::UnconnectedState && !m_client->m_connected)
+                    finish(false);
+            }, Qt::QueuedConnection);
         });
 
-        return subscription;
+        m_client->connect(m_host, m_port, m_options);
+
+        return true;
     }
 
-    inline void Client::unsubscribe(uint64_t ssid, int max_messages)
+    inline void ConnectAwaitable::finish(bool connected)
     {
-        QString message = QStringLiteral("UNSUB ") % QString::number(ssid) % (max_messages > 0 ? QString(" %1").arg(max_messages) : "") % CLRF;
+        QObject::disconnect(m_client, nullptr, &m_context, nullptr);
 
-        DEBUG("unsubscribed:" << message);
+        m_connected = connected;
 
-        m_socket.write(message.toUtf8());
-    }
-
-    inline uint64_t Client::request(const QString subject, MessageCallback callback)
-    {
-        return request(subject, "", callback);
+        std::exchange(m_handle, nullptr).resume();
     }
 
-    inline uint64_t Client::request(const QString subject, const QString message, MessageCallback callback)
+    inline RequestAwaitable::RequestAwaitable(Client *client, QByteArrayView subject, const Headers &headers, QByteArrayView payload, int timeout) :
+        m_client(client),
+        m_subject(subject.toByteArray()),
+        m_headers(headers),
+        m_payload(payload.toByteArray()),
+        m_timeout(timeout)
     {
-        QString inbox = QUuid::createUuid().toString();
-        uint64_t ssid = subscribe(inbox, callback);
-        unsubscribe(ssid, 1);
-        publish(subject, message, inbox);
-
-        return ssid;
+        // without deadline awaiting coroutine could wait forever
+        if(timeout <= 0)
+            m_reply.error = QStringLiteral("request timeout required");
     }
 
-    //! TODO: disconnect handling
-    inline void Client::set_listeners()
+    inline bool RequestAwaitable::await_suspend(std::coroutine_handle<> handle)
     {
-        DEBUG("set listeners");
-        QObject::connect(&m_socket, &QSslSocket::readyRead, this, [this]
+        const uint64_t id = m_client->request(m_subject, m_headers, m_payload, [this](const Message &message)
         {
+            m_reply.message = message;
+            m_reply.message.detach();
 
-            // add new data to buffer
-            m_buffer +=  m_socket.readAll();
+            m_handle.resume();
+        }, m_timeout, [this](const QString &error)
+        {
+            m_reply.error = error;
 
-            // process message if exists
-            int clrf_pos = m_buffer.lastIndexOf(CLRF);
-            if(clrf_pos != -1)
-            {
-                QByteArray msg_buffer = m_buffer.left(clrf_pos + CLRF.length());
-                process_inboud(msg_buffer);
-            }
+            // rejected publish fails before the coroutine is suspended
+            if(m_handle)
+                m_handle.resume();
         });
-    }
 
-    // parse incoming messages, see http://nats.io/documentation/internals/nats-protocol
-    // QStringView is used so we don't do unnecessary allocations
-    // TODO: error on invalid message
-    inline bool Client::process_inboud(const QByteArray &buffer)
-    {
-        DEBUG("handle message:" << buffer);
+        // error is set already, continue without suspending
+        if(id == 0)
+            return false;
 
-        // track movement inside buffer for parsing
-        int last_pos = 0, current_pos = 0;
+        m_handle = handle;
+        return true;
+    }
 
-        while(last_pos != buffer.length())
+    inline MessageStream::MessageStream(Client *client, const QString &subject, const QString &queue, int capacity) :
+        m_client(client),
+        m_capacity(qMax(1, capacity))
+    {
+        m_ssid = client->subscribe(subject, queue, [this](const Message &message)
         {
-            // we always get delimited message
-            current_pos = buffer.indexOf(CLRF, last_pos);
-            if(current_pos == -1)
-            {
-                qCritical() << "CLRF not found, this should not happen";
-                break;
-            }
-
-            QString operation(buffer.mid(last_pos, current_pos - last_pos));
-
-            // if this is PING operation, reply
-            if(operation.compare(QStringLiteral("PING"), Qt::CaseInsensitive) == 0)
-            {
-                DEBUG("sending pong");
-                m_socket.write(QString("PONG" % CLRF).toUtf8());
-                last_pos = current_pos + CLRF.length();
-                continue;
-            }
-            // +OK operation
-            else if(operation.compare(QStringLiteral("+OK"), Qt::CaseInsensitive) == 0)
-            {
-                DEBUG("+OK");
-                last_pos = current_pos + CLRF.length();
-                continue;
-            }
-            // if -ERR, close client connection | -ERR <error message>
-            else if(operation.indexOf("-ERR", 0, Qt::CaseInsensitive) != -1)
-            {
-                QStringView error_message = QStringView{operation}.mid(4);
-
-                qCritical() << "error" << error_message;
-
-                if(error_message.compare(QStringLiteral("Invalid Subject")) != 0)
-                    m_socket.close();
-
-                return false;
-            }
-            // only MSG should be now left
-            else if(operation.indexOf(QStringLiteral("MSG"), Qt::CaseInsensitive) != 0)
-            {
-                qCritical() << "invalid message - no message left";
-
-                m_buffer.remove(0,current_pos + CLRF.length());
-                return false;
-            }
-
-            // extract MSG data
-            // MSG format is: 'MSG <subject> <sid> [reply-to] <#bytes>\r\n[payload]\r\n'
-            // extract message_len = bytes and check if there is a message in this buffer
-            // if not, wait for next call, otherwise, extract all data
+            process_message(message);
+        });
+    }
 
-            int message_len = 0;
-            QString subject, sid, inbox;
+    inline MessageStream::~MessageStream()
+    {
+        close();
+    }
 
-            QList<QStringView> parts = QStringView{operation}.split(u" ", Qt::SkipEmptyParts);
+    inline void MessageStream::close()
+    {
+        if(m_closed)
+            return;
 
-            current_pos += CLRF.length();
+        m_closed = true;
 
-            if(parts.length() == 4)
-            {
-                message_len = parts[3].toInt();
-            }
-            else if (parts.length() == 5)
-            {
-                inbox = (parts[3]).toString();
-                message_len = parts[4].toInt();
-            }
-            else
-            {
-                qCritical() <<  "invalid message - wrong length" << parts.length();
-                break;
-            }
+        if(m_client)
+            m_client->unsubscribe(m_ssid);
 
-            if(current_pos + message_len + CLRF.length() > buffer.length())
-            {
-                DEBUG("message not in buffer, waiting");
-                break;
-            }
+        // reader gets the rest of buffer and then std::nullopt
+        if(m_waiting)
+            std::exchange(m_waiting, nullptr).resume();
+    }
 
-            operation = parts[0].toString();
-            subject = parts[1].toString();
-            sid = parts[2].toString();
-            uint64_t ssid = sid.toULong();
+    inline void MessageStream::process_message(const Message &message)
+    {
+        if(m_closed)
+            return;
 
-            QString message(buffer.mid(current_pos, message_len));
-            last_pos = current_pos + message_len + CLRF.length();
+        if(m_buffer.size() >= m_capacity)
+        {
+            m_dropped++;
+            return;
+        }
 
-            DEBUG("message:" << message);
+        Message copy = message;
+        copy.detach();
+        m_buffer.enqueue(std::move(copy));
 
-            // call correct subscription callback
-            if(m_callbacks.contains(ssid))
-            {
-                auto callback = m_callbacks[ssid];
-                callback(std::move(message), std::move(inbox), std::move(subject));
-            }
-            else
-            {
-                qWarning() << "invalid callback";
-            }
-        }
+        if(m_waiting)
+            std::exchange(m_waiting, nullptr).resume();
+    }
 
-        // remove processed messages from buffer
-        m_buffer.remove(0, last_pos);
+    inline std::optional<Message> MessageStream::NextAwaitable::await_resume()
+    {
+        if(m_stream->m_buffer.isEmpty())
+            return std::nullopt;
 
-        return true;
+        return m_stream->m_buffer.dequeue();
     }
+
+#endif // QT_NATS_COROUTINES
 }
 
 #endif // NATSCLIENT_H
@@ -0,0 +1,160 @@
+#include <QtTest>
+
+#include "../../benchmarks/common/bench.h"
+
+class ClientTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void flushSyncInCallback();
+    void routeWildcards();
+    void unrouteFromHandler();
+};
+
+void ClientTest::flushSyncInCallback()
+{
+    MockServer server;
+
+    // smallest read buffer so messages keep arriving over many reads
+    Nats::Options options;
+    options.read_buffer_size = 1024;
+    options.max_read_buffer_size = 1024;
+
+    Nats::Client publisher;
+    Nats::Client subscriber;
+    QVERIFY(publisher.connectSync("127.0.0.1", server.port()));
+    QVERIFY(subscriber.connectSync("127.0.0.1", server.port(), options));
+
+    const int count = 2000;
+    QList<QByteArray> received;
+    bool flushed = false;
+
+    const uint64_t ssid = subscriber.subscribe("foo", [&](const Nats::Message &message)
+    {
+        // deep copy, payload references the read buffer
+        const QByteArray before(message.payload.constData(), message.payload.size());
+
+        // nested reads must not overwrite message being delivered or the ones queued after it
+        if(received.size() % 100 == 0)
+            flushed = subscriber.flushSync() || flushed;
+
+        QCOMPARE(message.payload, before);
+        received.append(before);
+    });
+
+    subscriber.setPendingLimits(ssid, -1, -1);
+    QVERIFY(subscriber.flushSync());
+
+    for(int i = 0; i < count; ++i)
+        publisher.publishBytes("foo", QByteArray::number(i).leftJustified(64, '.'));
+
+    QVERIFY(publisher.flushSync());
+
+    QTRY_COMPARE_WITH_TIMEOUT(received.size(), count, 10000);
+    QVERIFY(flushed);
+
+    for(int i = 0; i < count; ++i)
+        QCOMPARE(received.at(i), QByteArray::number(i).leftJustified(64, '.'));
+}
+
+void ClientTest::routeWildcards()
+{
+    MockServer server;
+
+    Nats::Client publisher;
+    Nats::Client subscriber;
+    QVERIFY(publisher.connectSync("127.0.0.1", server.port()));
+    QVERIFY(subscriber.connectSync("127.0.0.1", server.port()));
+
+    QList<QByteArray> any;
+    QList<QByteArray> eu;
+    QList<QByteArray> us;
+    bool done = false;
+
+    // subject can reference the read buffer
+    auto subject = [](const Nats::Message &message)
+    {
+        return QByteArray(message.subject.constData(), message.subject.size());
+    };
+
+    Nats::Router router(&subscriber, "orders.>");
+
+    const uint64_t any_id = router.route("orders.*", [&](const Nats::Message &message) { any.append(subject(message)); });
+    router.route("orders.eu.>", [&](const Nats::Message &message) { eu.append(subject(message)); });
+    router.route("orders.done", [&](const Nats::Message &) { done = true; });
+
+    QCOMPARE(router.route("orders..bad", [](const Nats::Message &) {}), uint64_t(0));
+
+    // marker published last on the same connection, everything before it was routed
+    auto publish = [&](const QList<QByteArray> &subjects)
+    {
+        done = false;
+
+        for(const QByteArray &name : subjects)
+            publisher.publishBytes(name, "x");
+
+        publisher.publishBytes("orders.done", "");
+        QVERIFY(publisher.flushSync());
+        QTRY_VERIFY(done);
+    };
+
+    QVERIFY(subscriber.flushSync());
+
+    publish({"orders.eu", "orders.eu.new", "orders.us", "orders.eu.new.fast"});
+
+    QCOMPARE(any, QList<QByteArray>({"orders.eu", "orders.us", "orders.done"}));
+    QCOMPARE(eu, QList<QByteArray>({"orders.eu.new", "orders.eu.new.fast"}));
+
+    // cached matches follow route changes
+    router.unroute(any_id);
+    router.route("orders.us", [&](const Nats::Message &message) { us.append(subject(message)); });
+
+    any.clear();
+    eu.clear();
+
+    publish({"orders.us", "orders.eu", "orders.eu.new"});
+
+    QVERIFY(any.isEmpty());
+    QCOMPARE(eu, QList<QByteArray>({"orders.eu.new"}));
+    QCOMPARE(us, QList<QByteArray>({"orders.us"}));
+}
+
+void ClientTest::unrouteFromHandler()
+{
+    MockServer server;
+
+    Nats::Client publisher;
+    Nats::Client subscriber;
+    QVERIFY(publisher.connectSync("127.0.0.1", server.port()));
+    QVERIFY(subscriber.connectSync("127.0.0.1", server.port()));
+
+    Nats::Router router(&subscriber, "jobs.>");
+
+    int once = 0;
+    int all = 0;
+    uint64_t once_id = 0;
+
+    once_id = router.route("jobs.*", [&](const Nats::Message &)
+    {
+        once++;
+        router.unroute(once_id);
+    });
+
+    router.route("jobs.>", [&](const Nats::Message &) { all++; });
+
+    QVERIFY(subscriber.flushSync());
+
+    for(int i = 0; i < 3; ++i)
+        publisher.publishBytes("jobs.run", "x");
+
+    QVERIFY(publisher.flushSync());
+
+    QTRY_COMPARE(all, 3);
+    QCOMPARE(once, 1);
+}
+
+QTEST_GUILESS_MAIN(ClientTest)
+
+#include "tst_client.moc"
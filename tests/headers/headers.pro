@@ -0,0 +1,16 @@
+QT += core network testlib
+QT -= gui
+
+CONFIG += c++17
+
+TARGET = tst_headers
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += tst_headers.cpp
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+HEADERS += ../../natsclient.h
@@ -0,0 +1,141 @@
+#include <QtTest>
+
+#include "../../natsclient.h"
+
+class HeadersTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void noResponders();
+    void statusWithDescription();
+    void entries();
+    void multipleValues();
+    void whitespaceAndColons();
+    void bareLineFeeds();
+    void detachFromReadBuffer();
+    void modifyReceived();
+    void roundTrip();
+};
+
+void HeadersTest::noResponders()
+{
+    // status only block of HMSG reply when nobody listens on request subject
+    const Nats::Headers headers(QByteArray("NATS/1.0 503\r\n\r\n"));
+
+    QVERIFY(!headers.isEmpty());
+    QCOMPARE(headers.status(), 503);
+    QVERIFY(headers.description().isEmpty());
+    QVERIFY(!headers.contains("Status"));
+}
+
+void HeadersTest::statusWithDescription()
+{
+    const Nats::Headers headers(QByteArray("NATS/1.0 408 Request Timeout\r\nNats-Pending-Messages: 5\r\n\r\n"));
+
+    QCOMPARE(headers.status(), 408);
+    QCOMPARE(headers.description(), QByteArray("Request Timeout"));
+    QCOMPARE(headers.value("Nats-Pending-Messages"), QByteArray("5"));
+}
+
+void HeadersTest::entries()
+{
+    const Nats::Headers headers(QByteArray("NATS/1.0\r\nNats-Msg-Id: 42\r\nContent-Type: text/plain\r\n\r\n"));
+
+    QCOMPARE(headers.status(), 0);
+    QVERIFY(headers.description().isEmpty());
+
+    // keys are case-insensitive
+    QCOMPARE(headers.value("nats-msg-id"), QByteArray("42"));
+    QCOMPARE(headers.value("CONTENT-TYPE"), QByteArray("text/plain"));
+    QVERIFY(headers.contains("Nats-Msg-Id"));
+    QVERIFY(!headers.contains("Missing"));
+    QVERIFY(headers.value("Missing").isNull());
+}
+
+void HeadersTest::multipleValues()
+{
+    const Nats::Headers headers(QByteArray("NATS/1.0\r\nTag: a\r\nOther: x\r\ntag: b\r\nTAG: c\r\n\r\n"));
+
+    QCOMPARE(headers.values("Tag"), QList<QByteArray>({"a", "b", "c"}));
+    QCOMPARE(headers.value("Tag"), QByteArray("a"));
+    QCOMPARE(headers.values("Other"), QList<QByteArray>({"x"}));
+    QVERIFY(headers.values("Missing").isEmpty());
+}
+
+void HeadersTest::whitespaceAndColons()
+{
+    const Nats::Headers headers(QByteArray("NATS/1.0\r\nKey:   spaced value \t\r\nUrl: http://host:4222/x\r\nno colon line\r\n\r\n"));
+
+    QCOMPARE(headers.value("Key"), QByteArray("spaced value"));
+    QCOMPARE(headers.value("Url"), QByteArray("http://host:4222/x"));
+    QVERIFY(!headers.contains("no colon line"));
+}
+
+void HeadersTest::bareLineFeeds()
+{
+    const Nats::Headers headers(QByteArray("NATS/1.0 404 No Messages\nA: 1\n\n"));
+
+    QCOMPARE(headers.status(), 404);
+    QCOMPARE(headers.description(), QByteArray("No Messages"));
+    QCOMPARE(headers.value("A"), QByteArray("1"));
+}
+
+void HeadersTest::detachFromReadBuffer()
+{
+    QByteArray buffer("NATS/1.0\r\nKey: value\r\n\r\n");
+
+    // received headers reference the read buffer like parsed messages do
+    Nats::Headers headers(QByteArray::fromRawData(buffer.constData(), buffer.size()));
+    QCOMPARE(headers.value("Key"), QByteArray("value"));
+
+    headers.detach();
+    buffer.fill('x');
+
+    QCOMPARE(headers.value("Key"), QByteArray("value"));
+    QCOMPARE(headers.toByteArray(), QByteArray("NATS/1.0\r\nKey: value\r\n\r\n"));
+}
+
+void HeadersTest::modifyReceived()
+{
+    QByteArray buffer("NATS/1.0 503\r\nA: 1\r\nB: 2\r\n\r\n");
+    Nats::Headers headers(QByteArray::fromRawData(buffer.constData(), buffer.size()));
+
+    // modified headers own their data
+    headers.add("C", "3");
+    buffer.fill('x');
+
+    QCOMPARE(headers.status(), 503);
+    QCOMPARE(headers.value("A"), QByteArray("1"));
+    QCOMPARE(headers.value("C"), QByteArray("3"));
+
+    headers.set("a", "replaced");
+    headers.remove("B");
+
+    QCOMPARE(headers.values("A"), QList<QByteArray>({"replaced"}));
+    QVERIFY(!headers.contains("B"));
+    QCOMPARE(headers.toByteArray(), QByteArray("NATS/1.0 503\r\nC: 3\r\na: replaced\r\n\r\n"));
+}
+
+void HeadersTest::roundTrip()
+{
+    Nats::Headers headers;
+    QVERIFY(headers.isEmpty());
+
+    headers.add("Nats-Msg-Id", "1");
+    headers.add("Tag", "a");
+    headers.add("Tag", "b");
+    QVERIFY(!headers.isEmpty());
+
+    const Nats::Headers received(headers.toByteArray());
+
+    QCOMPARE(received.status(), 0);
+    QCOMPARE(received.value("Nats-Msg-Id"), QByteArray("1"));
+    QCOMPARE(received.values("Tag"), QList<QByteArray>({"a", "b"}));
+    QCOMPARE(received.toByteArray(), headers.toByteArray());
+}
+
+QTEST_APPLESS_MAIN(HeadersTest)
+
+#include "tst_headers.moc"
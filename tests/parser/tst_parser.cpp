@@ -0,0 +1,244 @@
+#include <QtTest>
+
+#include "../../natsclient.h"
+
+// records every parsed operation as text, arguments are copied since they reference the read buffer
+class Recorder : public Nats::Parser::Handler
+{
+public:
+    QList<QByteArray> events;
+
+    void process_msg(const Nats::MsgArg &arg, const QByteArray &headers, const QByteArray &payload) override
+    {
+        QByteArray event("MSG ");
+        event.append(arg.subject.constData(), arg.subject.size());
+        event.append(' ');
+        event.append(QByteArray::number(quint64(arg.ssid)));
+        event.append(" [");
+        event.append(arg.reply.constData(), arg.reply.size());
+        event.append("] {");
+        event.append(headers.constData(), headers.size());
+        event.append("} ");
+        event.append(payload.constData(), payload.size());
+
+        events.append(event);
+    }
+
+    void process_ping() override { events.append("PING"); }
+    void process_pong() override { events.append("PONG"); }
+    void process_ok() override { events.append("OK"); }
+    void process_err(QByteArrayView message) override { events.append("ERR " + message.toByteArray()); }
+    void process_info(QByteArrayView message) override { events.append("INFO " + message.toByteArray()); }
+};
+
+class ParserTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void wholeStream();
+    void splitAtEveryOffset();
+    void splitTwiceAtEveryOffset();
+    void byteByByte();
+    void maxPayload();
+    void hugeSizeWithoutMaxPayload();
+    void malformedArguments_data();
+    void malformedArguments();
+    void resetAfterError();
+    void parseUint();
+
+private:
+
+    static const QByteArray stream;
+
+    static QList<QByteArray> expected();
+
+    // parse given parts with one parser, false if any of them fails
+    static bool parseParts(const QList<QByteArray> &parts, Recorder &recorder);
+};
+
+// mixed stream, includes lowercase ops, tabs and extra spaces, CRLF in payload and status only HMSG
+const QByteArray ParserTest::stream =
+        "INFO {\"server_id\":\"x\",\"max_payload\":1048576}\r\n"
+        "PING\r\n"
+        "MSG foo 1 5\r\nhello\r\n"
+        "MSG foo.bar 22 _INBOX.x 0\r\n\r\n"
+        "+OK\r\n"
+        "PONG\r\n"
+        "msg  a\t3  bar 3\r\na\r\n\r\n"
+        "-ERR 'Unknown Protocol Operation'\r\n"
+        "MSG x 1 12\r\nhello\r\nworld\r\n"
+        "HMSG h 2 12 14\r\nNATS/1.0\r\n\r\nhi\r\n"
+        "hmsg h 3 rep 16 16\r\nNATS/1.0 503\r\n\r\n\r\n"
+        "pong\r\n";
+
+QList<QByteArray> ParserTest::expected()
+{
+    return {
+        "INFO {\"server_id\":\"x\",\"max_payload\":1048576}",
+        "PING",
+        "MSG foo 1 [] {} hello",
+        "MSG foo.bar 22 [_INBOX.x] {} ",
+        "OK",
+        "PONG",
+        "MSG a 3 [bar] {} a\r\n",
+        "ERR 'Unknown Protocol Operation'",
+        "MSG x 1 [] {} hello\r\nworld",
+        "MSG h 2 [] {NATS/1.0\r\n\r\n} hi",
+        "MSG h 3 [rep] {NATS/1.0 503\r\n\r\n} ",
+        "PONG"
+    };
+}
+
+bool ParserTest::parseParts(const QList<QByteArray> &parts, Recorder &recorder)
+{
+    Nats::Parser parser;
+
+    for(const QByteArray &part : parts)
+    {
+        // fresh copy of every part so nothing can rely on data of previous reads
+        if(!parser.parse(QByteArray(part.constData(), part.size()), recorder))
+            return false;
+    }
+
+    return true;
+}
+
+void ParserTest::wholeStream()
+{
+    Recorder recorder;
+    QVERIFY(parseParts({stream}, recorder));
+    QCOMPARE(recorder.events, expected());
+}
+
+void ParserTest::splitAtEveryOffset()
+{
+    for(qsizetype i = 0; i <= stream.size(); ++i)
+    {
+        Recorder recorder;
+        QVERIFY2(parseParts({stream.left(i), stream.mid(i)}, recorder), qPrintable(QString::number(i)));
+        QCOMPARE(recorder.events, expected());
+    }
+}
+
+void ParserTest::splitTwiceAtEveryOffset()
+{
+    for(qsizetype i = 0; i <= stream.size(); ++i)
+    {
+        for(qsizetype j = i; j <= stream.size(); ++j)
+        {
+            Recorder recorder;
+            if(!parseParts({stream.left(i), stream.mid(i, j - i), stream.mid(j)}, recorder) || recorder.events != expected())
+                QFAIL(qPrintable(QStringLiteral("split at %1 and %2").arg(i).arg(j)));
+        }
+    }
+}
+
+void ParserTest::byteByByte()
+{
+    QList<QByteArray> parts;
+    for(const char byte : stream)
+        parts.append(QByteArray(1, byte));
+
+    Recorder recorder;
+    QVERIFY(parseParts(parts, recorder));
+    QCOMPARE(recorder.events, expected());
+}
+
+void ParserTest::maxPayload()
+{
+    const QByteArray frames = "MSG foo 1 8\r\n12345678\r\nMSG foo 1 9\r\n123456789\r\n";
+
+    for(qsizetype i = 0; i <= frames.size(); ++i)
+    {
+        Nats::Parser parser;
+        parser.setMaxPayload(8);
+
+        Recorder recorder;
+        const bool parsed = parser.parse(frames.left(i), recorder) && parser.parse(frames.mid(i), recorder);
+
+        // frame at the limit is delivered, the one over it is rejected before its payload is read
+        QVERIFY(!parsed);
+        QVERIFY(parser.error().startsWith(QStringLiteral("maximum payload exceeded")));
+        QCOMPARE(recorder.events, QList<QByteArray>{"MSG foo 1 [] {} 12345678"});
+    }
+}
+
+void ParserTest::hugeSizeWithoutMaxPayload()
+{
+    // split payload of a size nobody checked must not be reserved up front
+    Nats::Parser parser;
+    Recorder recorder;
+
+    QVERIFY(parser.parse("MSG foo 1 999999999999999999\r\nabc", recorder));
+    QVERIFY(recorder.events.isEmpty());
+
+    // payload over the reserve limit still arrives whole
+    Nats::Parser limited;
+    limited.setMaxReserve(16);
+
+    const QByteArray payload(40, 'x');
+    QVERIFY(limited.parse("MSG foo 1 40\r\n" + payload.left(10), recorder));
+    QVERIFY(limited.parse(payload.mid(10) + "\r\nPING\r\n", recorder));
+    QCOMPARE(recorder.events, QList<QByteArray>({"MSG foo 1 [] {} " + payload, "PING"}));
+}
+
+void ParserTest::malformedArguments_data()
+{
+    QTest::addColumn<QByteArray>("input");
+
+    QTest::newRow("sid not a number") << QByteArray("MSG foo x 5\r\n");
+    QTest::newRow("size not a number") << QByteArray("MSG foo 1 x\r\n");
+    QTest::newRow("negative size") << QByteArray("MSG foo 1 -5\r\n");
+    QTest::newRow("missing size") << QByteArray("MSG foo\r\n");
+    QTest::newRow("too many arguments") << QByteArray("MSG foo 1 bar baz 5\r\n");
+    QTest::newRow("header size over total") << QByteArray("HMSG foo 1 9 5\r\n");
+    QTest::newRow("header size missing") << QByteArray("HMSG foo 1 5\r\n");
+    QTest::newRow("unknown operation") << QByteArray("XYZ\r\n");
+    QTest::newRow("broken PING") << QByteArray("PINX\r\n");
+}
+
+void ParserTest::malformedArguments()
+{
+    QFETCH(QByteArray, input);
+
+    for(qsizetype i = 0; i <= input.size(); ++i)
+    {
+        Nats::Parser parser;
+        Recorder recorder;
+
+        const bool parsed = parser.parse(input.left(i), recorder) && parser.parse(input.mid(i), recorder);
+
+        QVERIFY2(!parsed, qPrintable(QString::number(i)));
+        QVERIFY(!parser.error().isEmpty());
+        QVERIFY(recorder.events.isEmpty());
+    }
+}
+
+void ParserTest::resetAfterError()
+{
+    Nats::Parser parser;
+    Recorder recorder;
+
+    QVERIFY(!parser.parse("MSG foo x 5\r\n", recorder));
+
+    // new connection starts from clean state
+    parser.reset();
+
+    QVERIFY(parser.parse("PING\r\n", recorder));
+    QCOMPARE(recorder.events, QList<QByteArray>{"PING"});
+}
+
+void ParserTest::parseUint()
+{
+    QCOMPARE(Nats::Parser::parse_uint("0"), int64_t(0));
+    QCOMPARE(Nats::Parser::parse_uint("1048576"), int64_t(1048576));
+    QCOMPARE(Nats::Parser::parse_uint(""), int64_t(-1));
+    QCOMPARE(Nats::Parser::parse_uint("-1"), int64_t(-1));
+    QCOMPARE(Nats::Parser::parse_uint("12a"), int64_t(-1));
+}
+
+QTEST_APPLESS_MAIN(ParserTest)
+
+#include "tst_parser.moc"
@@ -0,0 +1,203 @@
+#include <QtTest>
+
+#include "../../natsclient.h"
+
+class SublistTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void literal();
+    void partialWildcard();
+    void fullWildcard();
+    void invalidSubjects_data();
+    void invalidSubjects();
+    void remove();
+    void cacheAfterInsert();
+    void cacheAfterRemove();
+    void cacheEviction();
+    void matches_data();
+    void matches();
+
+private:
+
+    // match result order follows the trie, compare sorted
+    static QList<uint64_t> match(Nats::Sublist &sublist, const QByteArray &subject);
+};
+
+QList<uint64_t> SublistTest::match(Nats::Sublist &sublist, const QByteArray &subject)
+{
+    QList<uint64_t> ids = sublist.match(subject);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void SublistTest::literal()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.bar", 1));
+    QVERIFY(sublist.insert("foo.bar", 2));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 2}));
+    QVERIFY(match(sublist, "foo").isEmpty());
+    QVERIFY(match(sublist, "foo.bar.baz").isEmpty());
+    QVERIFY(match(sublist, "foo.baz").isEmpty());
+    QCOMPARE(sublist.count(), qsizetype(2));
+}
+
+void SublistTest::partialWildcard()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.*", 1));
+    QVERIFY(sublist.insert("*.bar", 2));
+    QVERIFY(sublist.insert("*.*.baz", 3));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 2}));
+    QCOMPARE(match(sublist, "foo.baz"), QList<uint64_t>({1}));
+    QCOMPARE(match(sublist, "x.bar"), QList<uint64_t>({2}));
+    QCOMPARE(match(sublist, "foo.bar.baz"), QList<uint64_t>({3}));
+
+    // '*' is exactly one token
+    QVERIFY(match(sublist, "foo").isEmpty());
+    QVERIFY(match(sublist, "foo.bar.qux").isEmpty());
+}
+
+void SublistTest::fullWildcard()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.>", 1));
+    QVERIFY(sublist.insert(">", 2));
+    QVERIFY(sublist.insert("foo.*.>", 3));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 2}));
+    QCOMPARE(match(sublist, "foo.bar.baz"), QList<uint64_t>({1, 2, 3}));
+    QCOMPARE(match(sublist, "bar"), QList<uint64_t>({2}));
+
+    // '>' needs at least one token
+    QCOMPARE(match(sublist, "foo"), QList<uint64_t>({2}));
+}
+
+void SublistTest::invalidSubjects_data()
+{
+    QTest::addColumn<QByteArray>("subject");
+
+    QTest::newRow("empty") << QByteArray("");
+    QTest::newRow("empty token") << QByteArray("foo..bar");
+    QTest::newRow("leading dot") << QByteArray(".foo");
+    QTest::newRow("trailing dot") << QByteArray("foo.");
+    QTest::newRow("'>' not last") << QByteArray("foo.>.bar");
+}
+
+void SublistTest::invalidSubjects()
+{
+    QFETCH(QByteArray, subject);
+
+    Nats::Sublist sublist;
+    QVERIFY(!sublist.insert(subject, 1));
+    QCOMPARE(sublist.count(), qsizetype(0));
+}
+
+void SublistTest::remove()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.bar", 1));
+    QVERIFY(sublist.insert("foo.*", 2));
+    QVERIFY(sublist.insert("foo.>", 3));
+
+    QVERIFY(sublist.remove("foo.*", 2));
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 3}));
+
+    // only the exact subject and id pair can be removed
+    QVERIFY(!sublist.remove("foo.*", 2));
+    QVERIFY(!sublist.remove("foo.bar", 3));
+    QVERIFY(!sublist.remove("foo.bar.baz", 1));
+
+    QVERIFY(sublist.remove("foo.bar", 1));
+    QVERIFY(sublist.remove("foo.>", 3));
+
+    QVERIFY(match(sublist, "foo.bar").isEmpty());
+    QCOMPARE(sublist.count(), qsizetype(0));
+
+    // pruned nodes can be created again
+    QVERIFY(sublist.insert("foo.bar", 4));
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({4}));
+}
+
+void SublistTest::cacheAfterInsert()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.bar", 1));
+
+    // cache both a hit and a miss
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1}));
+    QVERIFY(match(sublist, "foo.baz").isEmpty());
+
+    QVERIFY(sublist.insert("foo.*", 2));
+    QVERIFY(sublist.insert(">", 3));
+    QVERIFY(sublist.insert("bar", 4));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 2, 3}));
+    QCOMPARE(match(sublist, "foo.baz"), QList<uint64_t>({2, 3}));
+}
+
+void SublistTest::cacheAfterRemove()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.bar", 1));
+    QVERIFY(sublist.insert("foo.>", 2));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1, 2}));
+    QCOMPARE(match(sublist, "foo.baz"), QList<uint64_t>({2}));
+
+    QVERIFY(sublist.remove("foo.>", 2));
+
+    QCOMPARE(match(sublist, "foo.bar"), QList<uint64_t>({1}));
+    QVERIFY(match(sublist, "foo.baz").isEmpty());
+}
+
+void SublistTest::cacheEviction()
+{
+    Nats::Sublist sublist;
+    QVERIFY(sublist.insert("foo.*", 1));
+
+    // more subjects than the cache holds, evicted and cached entries both stay correct
+    for(int i = 0; i < Nats::Sublist::max_cache * 2; ++i)
+        QCOMPARE(match(sublist, "foo." + QByteArray::number(i)), QList<uint64_t>({1}));
+
+    QVERIFY(sublist.remove("foo.*", 1));
+
+    for(int i = 0; i < Nats::Sublist::max_cache * 2; ++i)
+        QVERIFY(match(sublist, "foo." + QByteArray::number(i)).isEmpty());
+}
+
+void SublistTest::matches_data()
+{
+    QTest::addColumn<QByteArray>("pattern");
+    QTest::addColumn<QByteArray>("subject");
+    QTest::addColumn<bool>("result");
+
+    QTest::newRow("literal") << QByteArray("a.b") << QByteArray("a.b") << true;
+    QTest::newRow("literal differs") << QByteArray("a.b") << QByteArray("a.c") << false;
+    QTest::newRow("literal longer") << QByteArray("a") << QByteArray("a.b") << false;
+    QTest::newRow("'*' one token") << QByteArray("a.*") << QByteArray("a.b") << true;
+    QTest::newRow("'*' no token") << QByteArray("a.*") << QByteArray("a") << false;
+    QTest::newRow("'*' two tokens") << QByteArray("*") << QByteArray("a.b") << false;
+    QTest::newRow("'>' one token") << QByteArray("a.>") << QByteArray("a.b") << true;
+    QTest::newRow("'>' many tokens") << QByteArray("a.>") << QByteArray("a.b.c") << true;
+    QTest::newRow("'>' no token") << QByteArray("a.>") << QByteArray("a") << false;
+    QTest::newRow("invalid subject") << QByteArray("a.*") << QByteArray("a..b") << false;
+}
+
+void SublistTest::matches()
+{
+    QFETCH(QByteArray, pattern);
+    QFETCH(QByteArray, subject);
+    QFETCH(bool, result);
+
+    QCOMPARE(Nats::Sublist::matches(pattern, subject), result);
+}
+
+QTEST_APPLESS_MAIN(SublistTest)
+
+#include "tst_sublist.moc"
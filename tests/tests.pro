@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+# run with 'make check'
+SUBDIRS += \
+    parser \
+    headers \
+    sublist \
+    client